@@ -0,0 +1,95 @@
+#include "shell.h"
+
+// Command completion over a PATH of 20000 executables spread across four
+// directories: the time to build the index, to complete prefixes of each
+// length, and for a new binary to become completable through inotify.
+
+#define DIRS 4
+#define COMMANDS 20000
+
+static char root[] = "/tmp/myshell-complete-XXXXXX";
+
+static double now_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Names like "kar3f1": a spread of first letters, so prefixes thin out
+static void command_name(int i, char* name, size_t size) {
+    unsigned int h = hash_bytes((const char*)&i, sizeof(i));
+    snprintf(name, size, "%c%c%c%x", 'a' + h % 26, 'a' + (h >> 5) % 26, 'a' + (h >> 10) % 26, i);
+}
+
+static void make_executable(const char* dir, const char* name) {
+    char path[MAX_LEN];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+}
+
+static void free_matches(char** matches, size_t* count) {
+    *count = 0;
+    for (char** m = matches; *m != NULL; m++) {
+        free(*m);
+        (*count)++;
+    }
+    free(matches);
+}
+
+int main() {
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path_var[MAX_LEN] = "";
+    char dirs[DIRS][MAX_LEN];
+    for (int d = 0; d < DIRS; d++) {
+        snprintf(dirs[d], sizeof(dirs[d]), "%s/bin%d", root, d);
+        mkdir(dirs[d], 0755);
+        strcat(path_var, dirs[d]);
+        strcat(path_var, ":");
+    }
+    strcat(path_var, "/usr/bin:/bin");
+    for (int i = 0; i < COMMANDS; i++) {
+        char name[32];
+        command_name(i, name, sizeof(name));
+        make_executable(dirs[i % DIRS], name);
+    }
+    setenv("PATH", path_var, 1);
+    variables_init();
+
+    double start = now_usec();
+    path_index_build();
+    printf("index build: %.1f ms (%d executables + /usr/bin)\n\n", (now_usec() - start) / 1000, COMMANDS);
+
+    char sample[32];
+    command_name(COMMANDS / 2, sample, sizeof(sample));
+    printf("%-10s %-10s %-10s\n", "prefix", "matches", "usec");
+    for (size_t len = 1; len <= strlen(sample); len++) {
+        int runs = 200;
+        size_t count = 0;
+        start = now_usec();
+        for (int r = 0; r < runs; r++) {
+            free_matches(command_completions(sample, len), &count);
+        }
+        printf("%-10.*s %-10zu %-10.1f\n", (int)len, sample, count, (now_usec() - start) / runs);
+    }
+
+    // A new binary appearing, as seen by the next completion
+    start = now_usec();
+    make_executable(dirs[DIRS - 1], "zzz-new-tool");
+    size_t count = 0;
+    while (count == 0 && now_usec() - start < 1e6) {
+        free_matches(command_completions("zzz-new", 7), &count);
+    }
+    printf("\nnew binary completable after %.1f usec\n", now_usec() - start);
+
+    char rm[MAX_LEN];
+    snprintf(rm, sizeof(rm), "rm -rf %s", root);
+    return system(rm) == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include "shell.h"
+#include <time.h>
+
+// Conditions per second: an if whose condition and body are the test/[ and
+// : builtins, against the same loop with /usr/bin/[ and /bin/true, which is
+// what every condition cost before those commands ran in the shell. Each
+// loop is parsed once and run through handle_compound().
+//
+// usage: bench_conditions [builtin-depth] [external-depth]
+//        (the loops run 10^depth conditions)
+
+#define DIGITS "0 1 2 3 4 5 6 7 8 9"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int no_dispatch(char* line) {
+    fprintf(stderr, "bench: unexpected line: %s\n", line);
+    exit(1);
+}
+
+// depth nested for loops of ten words around body
+static double conditions_per_sec(const char* body, int depth) {
+    char line[MAX_LEN];
+    int len = 0;
+    for (int i = 0; i < depth; i++) {
+        len += snprintf(line + len, sizeof(line) - len, "for v%d in " DIGITS "; do ", i);
+    }
+    len += snprintf(line + len, sizeof(line) - len, "%s", body);
+    for (int i = 0; i < depth; i++) {
+        len += snprintf(line + len, sizeof(line) - len, "; done");
+    }
+
+    double start = now_sec();
+    handle_compound(line, no_dispatch);
+    double elapsed = now_sec() - start;
+    arena_reset(&command_arena);
+    if (last_status != 0) {
+        fprintf(stderr, "bench: loop failed: %s\n", body);
+        exit(1);
+    }
+
+    double count = 1;
+    for (int i = 0; i < depth; i++) count *= 10;
+    return count / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    int builtin_depth = argc > 1 ? atoi(argv[1]) : 5;
+    int external_depth = argc > 2 ? atoi(argv[2]) : 3;
+    interactive = 0;
+
+    const char* cases[][3] = {
+        {"file_test", "if [ -f /etc/passwd ]; then :; fi", "if /usr/bin/[ -f /etc/passwd ]; then /bin/true; fi"},
+        {"int_compare", "if test 3 -lt 10; then :; fi", "if /usr/bin/test 3 -lt 10; then /bin/true; fi"},
+        {"true", "if true; then :; fi", "if /bin/true; then /bin/true; fi"},
+    };
+
+    printf("%-12s %-14s %-14s %-8s\n", "condition", "builtin_per_s", "external_per_s", "speedup");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double builtin = conditions_per_sec(cases[i][1], builtin_depth);
+        double external = conditions_per_sec(cases[i][2], external_depth);
+        printf("%-12s %-14.0f %-14.0f %-8.1f\n", cases[i][0], builtin, external, builtin / external);
+    }
+    return 0;
+}
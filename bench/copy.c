@@ -0,0 +1,90 @@
+#include "shell.h"
+#include <time.h>
+
+// Compares the cat and cp stream builtins with the external binaries:
+// throughput (GB/s) for file-to-file, file-to-pipe and cp copies of a large
+// file, and launch cost for a command with an empty input. Command lines go
+// through tokenize() and execute() exactly as the shell runs them.
+//
+// usage: bench_copy [size-mb] [launch-runs]
+
+#define BENCH_DIR "/tmp/myshell-bench-copy"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_line(const char* line, int runs) {
+    char buf[MAX_LEN];
+    double start = now_sec();
+    for (int i = 0; i < runs; i++) {
+        snprintf(buf, sizeof(buf), "%s", line);
+        char** arglist = tokenize(buf);
+        execute(arglist);
+        arena_reset(&command_arena);
+        if (last_status != 0) {
+            fprintf(stderr, "bench: command failed: %s\n", line);
+            exit(1);
+        }
+    }
+    return now_sec() - start;
+}
+
+static void make_file(const char* path, size_t bytes) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    char* buf = malloc(1 << 20);
+    memset(buf, 'x', 1 << 20);
+    for (size_t done = 0; done < bytes; done += 1 << 20) {
+        if (write(fd, buf, 1 << 20) != 1 << 20) {
+            perror("write failed");
+            exit(1);
+        }
+    }
+    free(buf);
+    close(fd);
+}
+
+static void compare_throughput(const char* name, const char* builtin, const char* external, double gb) {
+    run_line(builtin, 1);  // warm the page cache
+    double in_shell = gb / run_line(builtin, 3) * 3;
+    double launched = gb / run_line(external, 3) * 3;
+    printf("%-14s %-12.2f %-12.2f %-8.2f\n", name, in_shell, launched, in_shell / launched);
+}
+
+int main(int argc, char* argv[]) {
+    int size_mb = argc > 1 ? atoi(argv[1]) : 512;
+    int runs = argc > 2 ? atoi(argv[2]) : 2000;
+    double gb = size_mb / 1024.0;
+    interactive = 0;
+
+    if (mkdir(BENCH_DIR, 0755) == -1 && access(BENCH_DIR, W_OK) != 0) {
+        perror(BENCH_DIR);
+        return 1;
+    }
+    make_file(BENCH_DIR "/big", (size_t)size_mb << 20);
+    make_file(BENCH_DIR "/empty", 0);
+
+    printf("%-14s %-12s %-12s %-8s\n", "copy", "builtin_GB/s", "binary_GB/s", "speedup");
+    compare_throughput("file_to_file",
+                       "cat " BENCH_DIR "/big > " BENCH_DIR "/out",
+                       "/bin/cat " BENCH_DIR "/big > " BENCH_DIR "/out", gb);
+    compare_throughput("file_to_pipe",
+                       "cat " BENCH_DIR "/big | /usr/bin/wc -c > /dev/null",
+                       "/bin/cat " BENCH_DIR "/big | /usr/bin/wc -c > /dev/null", gb);
+    compare_throughput("cp",
+                       "cp " BENCH_DIR "/big " BENCH_DIR "/out",
+                       "/bin/cp " BENCH_DIR "/big " BENCH_DIR "/out", gb);
+
+    double in_shell = run_line("cat " BENCH_DIR "/empty > /dev/null", runs) / runs;
+    double launched = run_line("/bin/cat " BENCH_DIR "/empty > /dev/null", runs) / runs;
+    printf("\n%-14s %-12s %-12s %-8s\n", "launch", "builtin_us", "binary_us", "speedup");
+    printf("%-14s %-12.1f %-12.1f %-8.1f\n", "cat_empty", in_shell * 1e6, launched * 1e6, launched / in_shell);
+
+    unlink(BENCH_DIR "/big");
+    unlink(BENCH_DIR "/empty");
+    unlink(BENCH_DIR "/out");
+    rmdir(BENCH_DIR);
+    return 0;
+}
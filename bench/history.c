@@ -0,0 +1,92 @@
+#include "shell.h"
+
+// history -s over a 1M-entry history: a mix of a few thousand commands
+// used over and over and one-off lines, like a real history file. Reports
+// the time to index it and per-search latency against a memmem() scan of
+// every entry.
+
+#define ENTRIES 1000000
+#define RUNS 200
+
+static double now_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static const char* verbs[] = {"git commit -m", "git checkout", "make -j8", "cd src/module", "vim lib/file",
+                              "grep -rn symbol", "ssh build-host", "docker run image", "kubectl get pods -n ns",
+                              "python3 tools/script", "ls -la dir", "cargo test case"};
+
+static void make_history(const char* path) {
+    char idx_path[MAX_LEN];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+    FILE* text = fopen(path, "w");
+    FILE* idx = fopen(idx_path, "w");
+    unsigned int seed = 1;
+    for (long i = 0; i < ENTRIES; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = seed >> 8;
+        int verb = r % (sizeof(verbs) / sizeof(verbs[0]));
+        // Two thirds come from 3000 recurring lines
+        unsigned int arg = r % 3 ? (r >> 4) % 3000 : (unsigned int)i;
+        uint64_t offset = ftell(text);
+        fwrite(&offset, sizeof(offset), 1, idx);
+        fprintf(text, "%s %u\n", verbs[verb], arg);
+    }
+    fclose(text);
+    fclose(idx);
+}
+
+// Baseline: count the entries containing pattern, one memmem() per entry
+static long linear_scan(const char* pattern) {
+    uint64_t* offsets = malloc(sizeof(uint64_t) * ENTRIES);
+    long n = history_store_offsets(0, offsets, ENTRIES);
+    long hits = 0;
+    for (long i = 0; i < n; i++) {
+        size_t len;
+        const char* text = history_store_text(offsets[i], &len);
+        if (text != NULL && memmem(text, len, pattern, strlen(pattern)) != NULL) hits++;
+    }
+    free(offsets);
+    return hits;
+}
+
+int main() {
+    char path[] = "/tmp/myshell-history-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    make_history(path);
+    setenv("HISTFILE", path, 1);
+    interactive = 0;
+
+    history_match matches[20];
+    double start = now_usec();
+    history_find("x", matches, 1);
+    printf("index %ld entries: %.0f ms\n\n", history_store_size(), (now_usec() - start) / 1000);
+
+    const char* patterns[] = {"gi", "git", "checkout", "make -j8 17", "pods -n ns 2999", "nomatch", NULL};
+    printf("%-18s %-8s %-12s %-12s\n", "pattern", "found", "indexed_us", "scan_us");
+    for (int p = 0; patterns[p] != NULL; p++) {
+        int found = 0;
+        start = now_usec();
+        for (int r = 0; r < RUNS; r++) {
+            found = history_find(patterns[p], matches, 20);
+        }
+        double indexed = (now_usec() - start) / RUNS;
+        start = now_usec();
+        linear_scan(patterns[p]);
+        double scan = now_usec() - start;
+        printf("%-18s %-8d %-12.1f %-12.0f\n", patterns[p], found, indexed, scan);
+    }
+
+    char idx_path[MAX_LEN];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+    unlink(path);
+    unlink(idx_path);
+    return 0;
+}
@@ -0,0 +1,279 @@
+#include "shell.h"
+
+// Lexer throughput and agreement. First every scanner (scalar, SSE2, AVX2)
+// is run over random lines full of quotes, $(...), operators and
+// redirections, at every alignment, and compared token by token with a
+// byte-at-a-time reference tokenizer; any difference fails the run. Then
+// each scanner lexes generated scripts and the throughput is reported in
+// MB/s.
+
+#define FUZZ_LINES 200000
+#define FUZZ_MAX 160
+#define SCRIPT_BYTES (32 * 1024 * 1024)
+#define RUNS 5
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char* scanners[] = {"scalar", "sse2", "avx2"};
+#define SCANNERS ((int)(sizeof(scanners) / sizeof(scanners[0])))
+
+static int is_operator_char(char c) {
+    return c == '<' || c == '>' || c == '|' || c == '&' || c == ';';
+}
+
+// The reference has its own operator and $(...) scanners, written from
+// the grammar rather than shared with the code under test
+
+// Optional descriptor digits, then <<<, <<, >>, or < or > with an
+// optional &- or &N. Returns the length, or 0 if s is no redirection.
+static size_t reference_redirection_length(const char* s) {
+    static const char* const fixed[] = {"<<<", "<<", ">>"};
+    size_t n = strspn(s, "0123456789");
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        size_t len = strlen(fixed[i]);
+        if (strncmp(s + n, fixed[i], len) == 0) {
+            return n + len;
+        }
+    }
+    if (s[n] != '<' && s[n] != '>') {
+        return 0;
+    }
+    n++;
+    if (s[n] == '&' && s[n + 1] == '-') {
+        return n + 2;
+    }
+    size_t digits = s[n] == '&' ? strspn(s + n + 1, "0123456789") : 0;
+    return digits > 0 ? n + 1 + digits : n;
+}
+
+// $( up to its matching ), counting parentheses outside double quotes.
+// Returns the length, or 0 if s does not start one that is closed.
+static size_t reference_substitution_length(const char* s) {
+    if (strncmp(s, "$(", 2) != 0) {
+        return 0;
+    }
+    int depth = 1;
+    int quoted = 0;
+    for (size_t i = 2; s[i] != '\0'; i++) {
+        if (s[i] == '"') {
+            quoted = !quoted;
+        } else if (quoted) {
+            continue;
+        } else if (s[i] == '(') {
+            depth++;
+        } else if (s[i] == ')' && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// The tokenizer as it was before the lexer: one byte at a time
+static int reference_tokenize(const char* cmdline, char** tokens, int max) {
+    const char* cp = cmdline;
+    int count = 0;
+    while (*cp != '\0' && count < max) {
+        while (*cp == ' ' || *cp == '\t') cp++;
+        if (*cp == '\0') break;
+        size_t redirection = reference_redirection_length(cp);
+        if (redirection > 0) {
+            tokens[count++] = strndup(cp, redirection);
+            cp += redirection;
+            continue;
+        }
+        if (is_operator_char(*cp)) {
+            tokens[count++] = strndup(cp, 1);
+            cp++;
+            continue;
+        }
+        const char* start = cp;
+        int in_quotes = 0;
+        while (*cp != '\0') {
+            size_t substitution = reference_substitution_length(cp);
+            if (substitution > 0) {
+                cp += substitution;
+                continue;
+            }
+            if (*cp == '"') {
+                in_quotes = !in_quotes;
+            } else if (!in_quotes && (*cp == ' ' || *cp == '\t' || is_operator_char(*cp))) {
+                break;
+            }
+            cp++;
+        }
+        char* word = malloc(cp - start + 1);
+        int len = 0;
+        for (const char* p = start; p < cp; p++) {
+            size_t substitution = reference_substitution_length(p);
+            if (substitution > 0) {
+                memcpy(word + len, p, substitution);
+                len += substitution;
+                p += substitution - 1;
+            } else if (*p != '"') {
+                word[len++] = *p;
+            }
+        }
+        word[len] = '\0';
+        tokens[count++] = word;
+    }
+    return count;
+}
+
+static unsigned int seed = 1;
+
+static unsigned int next_random() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// A random line. No two '<' with only quotes between them: a "<<" token
+// would read a here-document from stdin.
+static void fuzz_line(char* line, int len) {
+    static const char alphabet[] = "ab1-  \t\"\"$$(()<>|&;";
+    char last = 0;
+    for (int i = 0; i < len; i++) {
+        line[i] = alphabet[next_random() % (sizeof(alphabet) - 1)];
+        if (line[i] == '<' && last == '<') {
+            line[i] = 'x';
+        }
+        if (line[i] != '"') {
+            last = line[i];
+        }
+    }
+    line[len] = '\0';
+}
+
+static int fuzz() {
+    char* tokens[FUZZ_MAX + 1];
+    _Alignas(64) char buffer[FUZZ_MAX + 128];
+    char reference[FUZZ_MAX + 1];
+    long checked = 0;
+
+    for (int n = 0; n < FUZZ_LINES; n++) {
+        fuzz_line(reference, next_random() % FUZZ_MAX);
+        int count = reference_tokenize(reference, tokens, FUZZ_MAX);
+        // Chains are split the same way
+        char chain_copy[FUZZ_MAX + 1];
+        strcpy(chain_copy, reference);
+        char* rest = chain_copy;
+        int chain_len = 0;
+        while (chain_next(&rest) != NULL) chain_len++;
+
+        for (int s = 0; s < SCANNERS; s++) {
+            if (lexer_select(scanners[s]) != 0) continue;
+            // Every alignment within a 64-byte block
+            char* line = buffer + n % 64;
+            strcpy(line, reference);
+            char** words = lex_words(line);
+            int i = 0;
+            for (; words != NULL && words[i] != NULL; i++) {
+                if (i >= count || strcmp(words[i], tokens[i]) != 0) break;
+            }
+            rest = line;
+            int chained = 0;
+            while (chain_next(&rest) != NULL) chained++;
+            if (i != count || (words != NULL && words[i] != NULL) || chained != chain_len) {
+                fprintf(stderr, "lexer mismatch (%s) on: %s\n", scanners[s], reference);
+                return 1;
+            }
+            arena_reset(&command_arena);
+            checked++;
+        }
+        for (int i = 0; i < count; i++) free(tokens[i]);
+    }
+    printf("fuzz: %ld lines agree with the reference tokenizer\n", checked);
+    return 0;
+}
+
+static const char lorem[] =
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et "
+    "dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip "
+    "ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu "
+    "fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia.";
+
+static const char* commands[] = {
+    "ls -la /usr/local/lib",
+    "grep -rn \"some pattern with spaces\" src include > matches.txt 2>&1",
+    "echo \"building $(basename $(pwd)) for target\" | tee -a build.log",
+    "cc -O2 -Wall -Wextra -Iinclude -o build/module.o -c src/module/implementation_file.c",
+    "find . -name \"*.c\" | xargs wc -l | sort -n | tail -5",
+    "VAR=value; echo $VAR; cd /tmp; cat < input.txt >> output.txt",
+};
+
+enum { SCRIPT_COMMANDS, SCRIPT_WIDE, SCRIPT_STRINGS };
+
+// Lines of typical commands, one line of many arguments, or echo lines of
+// long quoted strings
+static char* make_script(int kind, size_t* size) {
+    char* script = malloc(SCRIPT_BYTES + 1024);
+    size_t len = 0;
+    unsigned int r = 7;
+    while (len < SCRIPT_BYTES) {
+        if (kind == SCRIPT_WIDE) {
+            len += sprintf(script + len, "arg%u \"quoted word %u\" ", r % 100000, r % 977);
+        } else if (kind == SCRIPT_STRINGS) {
+            int width = 100 + r % 300;
+            len += sprintf(script + len, "echo \"%.*s\" >> log.txt\n", width, lorem);
+        } else {
+            len += sprintf(script + len, "%s\n", commands[r % (sizeof(commands) / sizeof(commands[0]))]);
+        }
+        r = r * 1103515245 + 12345;
+    }
+    script[len] = '\0';
+    *size = len;
+    return script;
+}
+
+// Lex every line of the script; returns the tokens produced
+static long lex_script(char* script) {
+    long tokens = 0;
+    char* line = script;
+    while (line != NULL && *line != '\0') {
+        char* newline = strchr(line, '\n');
+        if (newline != NULL) *newline = '\0';
+        char** words = lex_words(line);
+        for (int i = 0; words != NULL && words[i] != NULL; i++) tokens++;
+        arena_reset(&command_arena);
+        if (newline != NULL) *newline = '\n';
+        line = newline ? newline + 1 : NULL;
+    }
+    return tokens;
+}
+
+static void throughput(const char* name, int kind) {
+    size_t size;
+    char* script = make_script(kind, &size);
+    printf("%-24s", name);
+    for (int s = 0; s < SCANNERS; s++) {
+        if (lexer_select(scanners[s]) != 0) {
+            printf("  %6s %9s", scanners[s], "n/a");
+            continue;
+        }
+        double best = 1e9;
+        long tokens = 0;
+        for (int run = 0; run < RUNS; run++) {
+            double start = now_sec();
+            tokens = lex_script(script);
+            double elapsed = now_sec() - start;
+            if (elapsed < best) best = elapsed;
+        }
+        (void)tokens;
+        printf("  %6s %5.0f MB/s", scanners[s], size / best / 1e6);
+    }
+    printf("\n");
+    free(script);
+}
+
+int main() {
+    if (fuzz() != 0) {
+        return 1;
+    }
+    throughput("command lines", SCRIPT_COMMANDS);
+    throughput("quoted strings", SCRIPT_STRINGS);
+    throughput("one 32MB line", SCRIPT_WIDE);
+    return 0;
+}
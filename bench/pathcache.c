@@ -0,0 +1,90 @@
+#include "shell.h"
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+
+// Counts the syscalls made per launch of `true` with and without the PATH
+// cache. The launch loop runs in a traced child; every process it creates is
+// traced too, so failed execve attempts made by posix_spawnp are included.
+// PATH is set to 12 entries with the real binaries at the end.
+
+static void launch_loop(int runs) {
+    char* argv[] = {"true", NULL};
+    for (int i = 0; i < runs; i++) {
+        int status;
+        pid_t pid = spawn_process(argv, NULL);
+        if (pid > 0) {
+            waitpid(pid, &status, 0);
+        }
+    }
+}
+
+// Run launch_loop under ptrace and count syscall entries (total and execve)
+static void count_syscalls(int runs, long* total, long* execs) {
+    *total = 0;
+    *execs = 0;
+
+    pid_t child = fork();
+    if (child == 0) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+        launch_loop(runs);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, child, NULL,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK |
+           PTRACE_O_TRACEVFORK | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+    while (1) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid == -1) {
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            continue;
+        }
+
+        int sig = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            struct __ptrace_syscall_info info;
+            ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info);
+            if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                (*total)++;
+                if (info.entry.nr == SYS_execve) {
+                    (*execs)++;
+                }
+            }
+        } else if (status >> 16 == 0 && WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTRAP) {
+            sig = WSTOPSIG(status);
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, sig);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+
+    char path[MAX_LEN] = "";
+    for (int i = 0; i < 10; i++) {
+        char dir[64];
+        snprintf(dir, sizeof(dir), "/nonexistent/myshell-bench-%d:", i);
+        strcat(path, dir);
+    }
+    strcat(path, "/usr/bin:/bin");
+    setenv("PATH", path, 1);
+
+    printf("%-10s %-16s %-16s\n", "cache", "syscalls/launch", "execve/launch");
+    for (int enabled = 0; enabled <= 1; enabled++) {
+        long total, execs;
+        path_cache_enabled = enabled;
+        path_cache_clear();
+        count_syscalls(runs, &total, &execs);
+        printf("%-10s %-16.1f %-16.1f\n", enabled ? "on" : "off",
+               (double)total / runs, (double)execs / runs);
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "shell.h"
+#include <time.h>
+
+// Measures how long handle_pipe takes to set up, run and reap a pipeline
+// of `true` stages, reported per stage.
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static char* build_pipeline(int stages) {
+    char* cmdline = malloc(stages * 8 + 1);
+    cmdline[0] = '\0';
+    for (int i = 0; i < stages; i++) {
+        strcat(cmdline, i == 0 ? "true" : " | true");
+    }
+    return cmdline;
+}
+
+static double run_pipeline(const char* cmdline) {
+    char* copy = strdup(cmdline);
+    char** arglist = tokenize(copy);
+
+    double start = now_us();
+    handle_pipe(arglist);
+    double elapsed = now_us() - start;
+
+    arena_reset(&command_arena);
+    free(copy);
+    return elapsed;
+}
+
+int main() {
+    int sizes[] = {2, 8, 32};
+    int runs[] = {200, 100, 30};
+
+    printf("%-8s %-6s %-12s %-12s\n", "stages", "runs", "total_us", "us/stage");
+    for (int i = 0; i < 3; i++) {
+        char* cmdline = build_pipeline(sizes[i]);
+
+        // Warm up page cache and the dynamic loader
+        run_pipeline(cmdline);
+
+        double total = 0;
+        for (int r = 0; r < runs[i]; r++) {
+            total += run_pipeline(cmdline);
+        }
+        double per_run = total / runs[i];
+        printf("%-8d %-6d %-12.1f %-12.1f\n", sizes[i], runs[i], per_run, per_run / sizes[i]);
+        free(cmdline);
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Lines per second for non-interactive execution of a generated 1M-line
+# script, read from a file and from a pipe. Lines are builtins only, so the
+# numbers measure the reader, tokenizer and dispatch rather than process
+# launch.
+#
+# usage: bench/script.sh path/to/myshell [lines]
+
+SHELL_BIN=${1:-bin/myshell}
+LINES=${2:-1000000}
+SCRIPT=$(mktemp /tmp/myshell-bench-XXXXXX)
+trap 'rm -f "$SCRIPT"' EXIT
+
+awk -v n="$LINES" 'BEGIN {
+    print "#!/usr/bin/env myshell"
+    for (i = 1; i < n; i++) {
+        if (i % 10 == 0) print "# comment " i
+        else printf "VAR_%d=\"value %d\"\n", i % 1000, i
+    }
+}' > "$SCRIPT"
+
+now() {
+    date +%s.%N
+}
+
+rate() {
+    awk -v n="$LINES" -v s="$1" -v e="$2" 'BEGIN { printf "%.0f", n / (e - s) }'
+}
+
+printf "%-8s %-10s %-12s\n" "mode" "lines" "lines/s"
+
+start=$(now)
+"$SHELL_BIN" "$SCRIPT"
+end=$(now)
+printf "%-8s %-10s %-12s\n" "file" "$LINES" "$(rate "$start" "$end")"
+
+start=$(now)
+cat "$SCRIPT" | "$SHELL_BIN"
+end=$(now)
+printf "%-8s %-10s %-12s\n" "pipe" "$LINES" "$(rate "$start" "$end")"
@@ -0,0 +1,49 @@
+#include "shell.h"
+#include <time.h>
+
+// Compares commands per second for the posix_spawn and fork launch paths.
+// Each run is repeated with a large touched heap to show how fork's cost
+// grows with the shell's address space while posix_spawn's does not.
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double commands_per_sec(int backend, int runs) {
+    char* argv[] = {"true", NULL};
+    spawn_backend = backend;
+
+    double start = now_sec();
+    for (int i = 0; i < runs; i++) {
+        int status;
+        pid_t pid = spawn_process(argv, NULL);
+        if (pid > 0) {
+            waitpid(pid, &status, 0);
+        }
+    }
+    return runs / (now_sec() - start);
+}
+
+int main(int argc, char* argv[]) {
+    int runs = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t heap_sizes[] = {0, 256};
+
+    printf("%-10s %-14s %-14s %-8s\n", "heap_mb", "fork_cmd/s", "spawn_cmd/s", "speedup");
+    for (int i = 0; i < 2; i++) {
+        size_t bytes = heap_sizes[i] << 20;
+        char* heap = NULL;
+        if (bytes > 0) {
+            heap = malloc(bytes);
+            memset(heap, 1, bytes);
+        }
+
+        double forked = commands_per_sec(SPAWN_FORK, runs);
+        double spawned = commands_per_sec(SPAWN_POSIX, runs);
+        printf("%-10zu %-14.0f %-14.0f %-8.2f\n", heap_sizes[i], forked, spawned, spawned / forked);
+
+        free(heap);
+    }
+    return 0;
+}
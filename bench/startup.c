@@ -0,0 +1,66 @@
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Invocations per second of "SHELL -c true" for each shell given, the way
+// cron and make start a shell for every command. The shell is run with an
+// empty stdin and the caller's environment.
+//
+// usage: bench_startup [-n runs] shell...
+
+extern char** environ;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double invocations_per_sec(const char* shell, int runs) {
+    char* argv[] = {(char*)shell, "-c", "true", NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", 0, 0);
+
+    double start = now_sec();
+    for (int i = 0; i < runs; i++) {
+        pid_t pid;
+        int status;
+        if (posix_spawn(&pid, shell, &actions, NULL, argv, environ) != 0 ||
+            waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "bench: %s -c true failed\n", shell);
+            exit(1);
+        }
+    }
+    double elapsed = now_sec() - start;
+    posix_spawn_file_actions_destroy(&actions);
+    return runs / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = 2000;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        runs = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "usage: bench_startup [-n runs] shell...\n");
+        return 2;
+    }
+
+    printf("%-32s %-12s %-10s\n", "shell", "runs_per_s", "usec_each");
+    for (int i = first; i < argc; i++) {
+        if (access(argv[i], X_OK) != 0) {
+            continue;
+        }
+        invocations_per_sec(argv[i], runs / 10 + 1);  // warm the page cache
+        double rate = invocations_per_sec(argv[i], runs);
+        printf("%-32s %-12.0f %-10.1f\n", argv[i], rate, 1e6 / rate);
+    }
+    return 0;
+}
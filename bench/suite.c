@@ -0,0 +1,225 @@
+#include "shell.h"
+#include <time.h>
+
+// Reproducible performance suite run by `make bench`.
+//
+// Micro benchmarks call tokenize(), expand_variables() and
+// is_variable_assignment() in-process. End-to-end scenarios run the real
+// shell binary on generated scripts that repeat a scenario many times, so
+// shell startup is amortised away. Results are written as CSV and JSON,
+// tagged with the version string the Makefile passes in, so runs from
+// different versions can be compared.
+//
+// usage: bench_suite path/to/myshell [output-prefix]
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+#define MAX_RESULTS 64
+#define MICRO_MIN_SECONDS 0.2
+#define SCENARIO_RUNS 3
+
+typedef struct {
+    const char* name;
+    double value;
+    const char* unit;
+} bench_result;
+
+static bench_result results[MAX_RESULTS];
+static int result_count = 0;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void record(const char* name, double value, const char* unit) {
+    if (result_count < MAX_RESULTS) {
+        results[result_count].name = name;
+        results[result_count].value = value;
+        results[result_count].unit = unit;
+        result_count++;
+    }
+    printf("%-28s %14.2f %s\n", name, value, unit);
+}
+
+// Run fn in growing batches until MICRO_MIN_SECONDS have passed and return
+// the time per call in nanoseconds
+static double ns_per_op(void (*fn)()) {
+    long iterations = 1000;
+    while (1) {
+        double start = now_sec();
+        for (long i = 0; i < iterations; i++) {
+            fn();
+        }
+        double elapsed = now_sec() - start;
+        if (elapsed >= MICRO_MIN_SECONDS) {
+            return elapsed * 1e9 / iterations;
+        }
+        iterations *= 4;
+    }
+}
+
+// Micro benchmarks
+
+static long micro_calls = 0;
+
+// Release the arena now and then, as the shell does once per command
+static void micro_arena_tick() {
+    if (++micro_calls % 1024 == 0) {
+        arena_reset(&command_arena);
+    }
+}
+
+static void micro_tokenize() {
+    char cmdline[] = "grep -n \"needle in haystack\" /var/log/syslog | sort -r > /tmp/out.txt &";
+    tokenize(cmdline);
+    micro_arena_tick();
+}
+
+static void micro_expand_variables() {
+    char* arglist[] = {"echo", "$BENCH_A", "plain", "$BENCH_B", "$BENCH_MISSING", NULL};
+    expand_variables(arglist);
+    micro_arena_tick();
+}
+
+static void micro_is_variable_assignment() {
+    static char* cases[][2] = {
+        {"NAME=value", NULL},
+        {"ls", NULL},
+        {"long_variable_name_1=x", NULL},
+        {"1BAD=x", NULL},
+    };
+    for (int i = 0; i < 4; i++) {
+        is_variable_assignment(cases[i]);
+    }
+}
+
+// End-to-end scenarios
+
+static const char* shell_binary;
+
+// Write `repeat` copies of body to a temporary script and return the seconds
+// the shell takes to run it
+static double run_script_scenario(const char* body, int repeat) {
+    char path[] = "/tmp/myshell-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("mkstemp failed");
+        exit(1);
+    }
+    FILE* fp = fdopen(fd, "w");
+    for (int i = 0; i < repeat; i++) {
+        fputs(body, fp);
+    }
+    fclose(fp);
+
+    char* argv[] = {(char*)shell_binary, path, NULL};
+    double start = now_sec();
+    pid_t pid = spawn_process(argv, NULL);
+    int status = 0;
+    if (pid > 0) {
+        waitpid(pid, &status, 0);
+    }
+    double elapsed = now_sec() - start;
+
+    unlink(path);
+    if (pid <= 0 || wait_status(status) != 0) {
+        fprintf(stderr, "bench: scenario failed: %s", body);
+    }
+    return elapsed;
+}
+
+// Best of SCENARIO_RUNS, which is far more stable than the mean
+static double best_script_scenario(const char* body, int repeat) {
+    double best = run_script_scenario(body, repeat);
+    for (int i = 1; i < SCENARIO_RUNS; i++) {
+        double elapsed = run_script_scenario(body, repeat);
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static void scenarios() {
+    const int n = 1000;
+
+    // Warm the page cache for the binaries the scenarios use
+    run_script_scenario("true\nyes | head -c 1 > /dev/null\n", 10);
+
+    double empty = best_script_scenario("# nothing\n", 1);
+    double spawn = (best_script_scenario("true\n", n) - empty) / n;
+    record("e2e_spawn_true", spawn * 1e6, "us/cmd");
+
+    double redirect = (best_script_scenario("true > /dev/null < /dev/null\n", n) - empty) / n;
+    record("e2e_redirect", redirect * 1e6, "us/cmd");
+    record("e2e_redirect_overhead", (redirect - spawn) * 1e6, "us/cmd");
+
+    double block = (best_script_scenario("if true\nthen\ntrue\nfi\n", n) - empty) / n;
+    record("e2e_if_block", block * 1e6, "us/block");
+
+    const double bytes = 256.0 * 1024 * 1024;
+    double pipeline = best_script_scenario("yes | head -c 268435456 > /dev/null\n", 1) - empty;
+    record("e2e_pipeline_yes_head", bytes / pipeline / (1024 * 1024), "MiB/s");
+}
+
+// Output
+
+static void write_csv(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(fp, "version,benchmark,value,unit\n");
+    for (int i = 0; i < result_count; i++) {
+        fprintf(fp, "%s,%s,%.3f,%s\n", BENCH_VERSION, results[i].name, results[i].value, results[i].unit);
+    }
+    fclose(fp);
+}
+
+static void write_json(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(fp, "{\n  \"version\": \"%s\",\n  \"timestamp\": %ld,\n  \"results\": [\n",
+            BENCH_VERSION, (long)time(NULL));
+    for (int i = 0; i < result_count; i++) {
+        fprintf(fp, "    {\"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\"}%s\n",
+                results[i].name, results[i].value, results[i].unit,
+                i < result_count - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s path/to/myshell [output-prefix]\n", argv[0]);
+        return 2;
+    }
+    shell_binary = argv[1];
+    const char* prefix = argc > 2 ? argv[2] : "bench_results";
+
+    var_set("BENCH_A", 7, "alpha", 0);
+    var_set("BENCH_B", 7, "a somewhat longer value", 0);
+
+    printf("myshell benchmark suite (%s)\n\n", BENCH_VERSION);
+    record("micro_tokenize", ns_per_op(micro_tokenize), "ns/op");
+    record("micro_expand_variables", ns_per_op(micro_expand_variables), "ns/op");
+    record("micro_is_variable_assignment", ns_per_op(micro_is_variable_assignment) / 4, "ns/op");
+    arena_reset(&command_arena);
+
+    scenarios();
+
+    char path[MAX_LEN];
+    snprintf(path, sizeof(path), "%s.csv", prefix);
+    write_csv(path);
+    snprintf(path, sizeof(path), "%s.json", prefix);
+    write_json(path);
+    printf("\nResults written to %s.csv and %s.json\n", prefix, prefix);
+    return 0;
+}
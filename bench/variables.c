@@ -0,0 +1,62 @@
+#include "shell.h"
+#include <time.h>
+
+// Assignment and expansion throughput of the variable store at 10, 1k and
+// 100k variables. Each size does about a million operations of each kind.
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main() {
+    int sizes[] = {10, 1000, 100000};
+    const int target_ops = 1000000;
+
+    printf("%-10s %-16s %-16s\n", "vars", "assign_ops/s", "expand_ops/s");
+    for (int s = 0; s < 3; s++) {
+        int n = sizes[s];
+        int passes = target_ops / n;
+        char** assignments = malloc(sizeof(char*) * n);
+        char** references = malloc(sizeof(char*) * n);
+        for (int i = 0; i < n; i++) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "VAR_%d=value_%d", i, i);
+            assignments[i] = strdup(buf);
+            snprintf(buf, sizeof(buf), "$VAR_%d", i);
+            references[i] = strdup(buf);
+        }
+
+        variables_clear();
+
+        double start = now_sec();
+        for (int p = 0; p < passes; p++) {
+            for (int i = 0; i < n; i++) {
+                char* arglist[] = {assignments[i], NULL};
+                handle_variables(arglist);
+            }
+        }
+        double assign_rate = (double)passes * n / (now_sec() - start);
+
+        start = now_sec();
+        for (int p = 0; p < passes; p++) {
+            for (int i = 0; i < n; i++) {
+                char* arglist[] = {references[i], NULL};
+                expand_variables(arglist);
+            }
+            arena_reset(&command_arena);
+        }
+        double expand_rate = (double)passes * n / (now_sec() - start);
+
+        printf("%-10d %-16.0f %-16.0f\n", n, assign_rate, expand_rate);
+
+        for (int i = 0; i < n; i++) {
+            free(assignments[i]);
+            free(references[i]);
+        }
+        free(assignments);
+        free(references);
+    }
+    return 0;
+}
@@ -12,51 +12,357 @@
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <stdint.h>
 
 #define MAX_LEN 1024
-#define MAXARGS 64
-#define ARGLEN 64
 #define PROMPT "myshell> "
-#define HISTORY_SIZE 20
-#define MAX_JOBS 20
-#define MAX_BLOCK_LINES 20
-#define MAX_VARS 50
+#define HISTORY_SIZE 100000
 
 // Function declarations
 char* read_cmd(char* prompt, FILE* fp);
+char* event_read_line(const char* prompt);
+int event_read_key();
+void readline_init();
 char** tokenize(char* cmdline);
+
+// Lexer
+char** lex_words(const char* cmdline);
+char* chain_next(char** rest);
+int lexer_select(const char* name);
 int execute(char* arglist[]);
 int handle_builtin(char** arglist);
 void add_to_history(const char* cmdline);
-void print_history();
-int execute_from_history(int n);
+void print_history(int last);
+char* history_entry(int n);
+long history_store_size();
+long history_store_offsets(long first, uint64_t* offsets, long max);
+const char* history_store_text(uint64_t offset, size_t* len);
+int history_number(uint64_t offset);
+
+// Indexed history search
+typedef struct {
+    uint64_t offset;   // most recent use
+    int count;         // uses in the whole history
+} history_match;
+
+int history_find(const char* pattern, history_match* matches, int max);
+int print_history_search(const char* pattern);
+int history_search_key(int count, int key);
 int handle_redirection(char** arglist);
 int handle_pipe(char** arglist);
-int parse_redirection(char** arglist, char** input_file, char** output_file);
-int handle_chain_commands(char* cmdline);
+int handle_chain_commands(char* cmdline, int (*dispatch)(char*));
 int handle_background(char** arglist);
+
+// Background jobs
+typedef enum { JOB_FREE, JOB_QUEUED, JOB_RUNNING, JOB_DONE } job_state;
+
+typedef struct {
+    int id;
+    pid_t pid;
+    job_state state;
+    int status;
+    struct timespec queued;   // submitted
+    struct timespec start;    // started running
+    struct timespec end;
+    char* command;
+    char* placement;    // "cpus=0-3 nice=10", or NULL
+    struct queued_job* pending;   // what to start, while queued
+    int reported;       // prompt its Done notice was printed at, or 0
+    int next_free;
+    int next_queued;
+} job;
+
+void jobs_init();
+int add_job(pid_t pid, char** arglist);
+int job_submit(char** arglist);
+int jobs_limit();
+void jobs_set_limit(int limit);
+void jobs_drain_queue();
+pid_t spawn_background(char** arglist);
+job* job_get(int id);
+void remove_job(job* j);
 void cleanup_background_jobs();
+void jobs_report_at_prompt();
+void jobs_next_prompt();
 void print_jobs();
-int handle_if_then_else(char* cmdline);
-char* read_multiline_block(const char* prompt);
-int execute_command_block(char** commands, int count);
+void wait_for_children(pid_t* pids, int* statuses, struct rusage* usages, int count);
+int wait_for_child(pid_t pid);
+int wait_for_any(pid_t* pids, int count, int* status);
+void wait_for_all_jobs();
+
+// Resource accounting (time keyword and MYSHELL_TIMELOG)
+typedef struct acct_frame {
+    struct timespec start;
+    struct rusage self_start;
+    struct rusage children;
+    struct acct_frame* prev;
+    double real;
+    double user;
+    double sys;
+    long maxrss;
+    long nvcsw;
+    long nivcsw;
+    long inblock;
+    long oublock;
+} acct_frame;
+
+void acct_begin(acct_frame* f);
+void acct_end(acct_frame* f);
+void acct_add(const struct rusage* ru);
+void acct_timing_begin(acct_frame* f);
+void acct_timing_end(acct_frame* f);
+int acct_timing();
+void acct_print_stage(int n, const char* name, const struct rusage* ru);
+void acct_log(const char* path, const acct_frame* f, int status, const char* cmdline);
+
+// Buffered input for scripts, -c and piped stdin
+typedef struct {
+    int fd;
+    char* buf;
+    size_t size;
+    size_t start;
+    size_t end;
+    int eof;
+} input_reader;
+
+input_reader* input_open_fd(int fd);
+input_reader* input_open_string(const char* s);
+char* input_read_line(input_reader* in);
+void input_close(input_reader* in);
+char* read_input_line(const char* prompt);
+
+// Per-command arena allocator
+typedef struct arena_block arena_block;
+
+typedef struct {
+    arena_block* head;
+} arena;
+
+typedef struct {
+    arena_block* block;
+    size_t used;
+} arena_mark;
+
+void* arena_alloc(arena* a, size_t size);
+char* arena_strdup(arena* a, const char* s);
+char* arena_strndup(arena* a, const char* s, size_t len);
+void arena_reset(arena* a);
+void arena_destroy(arena* a);
+arena_mark arena_save(arena* a);
+void arena_restore(arena* a, arena_mark mark);
+
+// Spawn functions
+typedef enum {
+    SPAWN_ACTION_OPEN,
+    SPAWN_ACTION_DUP2,
+    SPAWN_ACTION_CLOSE
+} spawn_action_type;
+
+typedef struct {
+    spawn_action_type type;
+    int fd;
+    int src_fd;
+    const char* path;
+    int flags;
+    mode_t mode;
+    int owned;          // src_fd is closed with the list
+} spawn_action;
+
+typedef struct {
+    spawn_action* items;
+    int count;
+    int capacity;
+} spawn_actions;
+
+enum { SPAWN_POSIX, SPAWN_FORK };
+
+void spawn_init();
+void spawn_actions_init(spawn_actions* actions);
+void spawn_actions_reset(spawn_actions* actions);
+void spawn_actions_free(spawn_actions* actions);
+int spawn_add_open(spawn_actions* actions, int fd, const char* path, int flags, mode_t mode);
+int spawn_add_dup2(spawn_actions* actions, int src_fd, int fd);
+int spawn_add_fd(spawn_actions* actions, int src_fd, int fd);
+int spawn_add_close(spawn_actions* actions, int fd);
+int spawn_actions_apply(const spawn_actions* actions);
+pid_t spawn_process(char** argv, const spawn_actions* actions);
+int wait_status(int status);
+
+// Redirections: < > >> N< N> N>> N>&M N<&M N>&- <<WORD <<<word
+enum {
+    REDIR_NONE,
+    REDIR_IN,
+    REDIR_OUT,
+    REDIR_APPEND,
+    REDIR_DUP,
+    REDIR_CLOSE,
+    REDIR_HEREDOC,
+    REDIR_HEREDOC_LITERAL,
+    REDIR_HERESTRING
+};
+
+size_t redirection_length(const char* s);
+int redirection_kind(const char* token);
+char* heredoc_literal(const char* op);
+void heredoc_collect(char** arglist);
+int redirection_actions(char** arglist, spawn_actions* actions);
+
+// Control structures, parsed once into a tree
+typedef enum {
+    NODE_COMMAND,
+    NODE_LINE,
+    NODE_IF,
+    NODE_WHILE,
+    NODE_FOR,
+    NODE_BREAK,
+    NODE_CONTINUE
+} node_type;
+
+typedef struct node {
+    node_type type;
+    struct node* next;       // next statement in the same list
+    char** argv;             // command tokens, or the words of a for loop
+    int argc;
+    char* text;              // raw line (NODE_LINE) or for loop variable
+    struct node* cond;
+    struct node* body;
+    struct node* else_body;  // else branch; an elif is a nested NODE_IF
+    int has_else;
+} node;
+
+int is_compound_start(char* line);
+int handle_compound(char* line, int (*dispatch)(char*));
+
+// Parallel blocks
+int run_parallel(char** commands, int count, int max_jobs, int (*run)(char*));
+int handle_parallel(char* args, int (*run)(char*));
+
+// Pipe capacity and metering
+typedef struct pipe_meter pipe_meter;
+
+long parse_size(const char* size);
+int pipe_open(int fds[2]);
+int pipe_metering();
+pipe_meter* pipe_meter_relay(int stage_count, int* relay_in, int* relay_out);
+void pipe_meter_report(pipe_meter* meter, char*** stages);
+
+// Job placement: pin, nice and cg prefixes
+typedef struct {
+    int has_cpus;
+    cpu_set_t cpus;
+    char cpus_text[64];
+    int nice;
+    char cgroup[256];
+} placement;
+
+extern placement job_placement;
+int placement_active();
+int placement_parse_cpus(const char* spec, cpu_set_t* set);
+int placement_set_cpus(const char* spec);
+int placement_set_nice(char** line);
+int placement_set_cgroup(const char* path);
+int placement_apply();
+char* placement_describe();
+
+// Stream builtins (cat, tee, cp, echo, printf, test, true, false, :): run
+// by the shell itself, but with their own stdin/stdout/stderr so they can
+// be redirected and piped
+typedef struct {
+    int fd[3];
+    int owned[3];
+    // Descriptors above 2 set up by the redirections (N in N>FILE), always
+    // owned by the table; only there to be duplicated by a later N>&M
+    int extra_count;
+    int* extra_target;
+    int* extra_fd;
+} stdio_fds;
+
+typedef int (*stream_builtin_fn)(char** argv, stdio_fds* io);
+
+typedef struct {
+    const char* name;
+    stream_builtin_fn fn;
+    const char* options;
+} stream_builtin;
+
+stream_builtin_fn stream_builtin_find(char** argv);
+int stdio_fds_open(stdio_fds* io, const spawn_actions* actions);
+void stdio_fds_close(stdio_fds* io);
+int stream_builtin_call(stream_builtin_fn fn, char** argv, stdio_fds* io);
+int run_stream_builtin(stream_builtin_fn fn, char** argv, const spawn_actions* actions);
+pid_t spawn_stream_builtin(stream_builtin_fn fn, char** argv, const spawn_actions* actions);
+int copy_fd(int in, int out);
+int builtin_cat(char** argv, stdio_fds* io);
+int builtin_tee(char** argv, stdio_fds* io);
+int builtin_cp(char** argv, stdio_fds* io);
+int builtin_echo(char** argv, stdio_fds* io);
+int builtin_printf(char** argv, stdio_fds* io);
+int builtin_true(char** argv, stdio_fds* io);
+int builtin_false(char** argv, stdio_fds* io);
+int builtin_test(char** argv, stdio_fds* io);
+
+// PATH command cache
+unsigned int hash_bytes(const char* s, size_t len);
+unsigned int hash_string(const char* s);
+const char* path_lookup(const char* name);
+void path_cache_invalidate(const char* name);
+void path_cache_clear();
+int handle_hash(char** arglist);
+
+// Command completion and the PATH index
+void completion_init();
+int path_index_build();
+void path_index_refresh();
+int path_index_fd();
+const char* path_index_lookup(const char* name, char* buf, size_t size);
+char** command_completions(const char* prefix, size_t len);
 
 // Variable functions
+#define VAR_EXPORTED 1
+
+void variables_init();
+void variables_clear();
+const char* var_lookup(const char* name, size_t len);
+const char* var_get(const char* name);
+void var_set(const char* name, size_t len, const char* value, int flags);
+void var_export(const char* name);
+int var_unset(const char* name);
+int handle_export(char** arglist);
+int handle_unset(char** arglist);
 void handle_variables(char** arglist);
-void expand_variables(char** arglist);
 void print_variables();
+char** var_names_with_prefix(const char* prefix, size_t len);
 int is_variable_assignment(char** arglist);
 
+// Execution tracing
+extern int trace_enabled;
+uint64_t trace_now();
+void trace_span(const char* cat, const char* name, uint64_t start, const char* detail);
+void trace_child_start(pid_t pid, char** argv);
+void trace_child_end(pid_t pid, int status);
+int trace_start(const char* path);
+void trace_stop();
+
+// Word expansion
+extern int (*substitution_runner)(char*);
+extern pid_t shell_pid;
+size_t substitution_length(const char* s);
+char* expand_word(char* word);
+void expand_variables(char** arglist);
+
 // External declarations
-extern char* history[HISTORY_SIZE];
 extern int history_count;
-extern pid_t background_jobs[MAX_JOBS];
 extern int job_count;
-extern char* job_commands[MAX_JOBS];
-
-// Variable externs
-extern char* var_names[MAX_VARS];
-extern char* var_values[MAX_VARS];
-extern int var_count;
+extern int last_status;
+extern int interactive;
+extern input_reader* script_input;
+extern int spawn_backend;
+extern int path_cache_enabled;
+extern long pipe_size_override;
+extern int pipe_meter_override;
+extern arena command_arena;
 
 #endif
@@ -0,0 +1,125 @@
+#include "shell.h"
+#include <errno.h>
+#include <sys/time.h>
+
+// Resource accounting for the `time` keyword and the per-command log.
+//
+// Every foreground child is reaped with wait4(), and its rusage is added to
+// each open measurement frame. A frame also records the shell's own usage
+// (getrusage(RUSAGE_SELF)) so that builtins and parsing are counted.
+// Frames nest, so `time` works inside a logged script.
+
+static acct_frame* acct_frames = NULL;
+static int acct_timing_depth = 0;
+
+static int acct_log_fd = -1;
+static char* acct_log_path = NULL;
+
+static double timeval_sec(const struct timeval* tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void acct_begin(acct_frame* f) {
+    clock_gettime(CLOCK_MONOTONIC, &f->start);
+    getrusage(RUSAGE_SELF, &f->self_start);
+    memset(&f->children, 0, sizeof(f->children));
+    f->prev = acct_frames;
+    acct_frames = f;
+}
+
+// Close the innermost frame and fill in its totals
+void acct_end(acct_frame* f) {
+    struct timespec end;
+    struct rusage self;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self);
+    acct_frames = f->prev;
+
+    f->real = (end.tv_sec - f->start.tv_sec) + (end.tv_nsec - f->start.tv_nsec) / 1e9;
+    f->user = timeval_sec(&f->children.ru_utime) + timeval_sec(&self.ru_utime)
+              - timeval_sec(&f->self_start.ru_utime);
+    f->sys = timeval_sec(&f->children.ru_stime) + timeval_sec(&self.ru_stime)
+             - timeval_sec(&f->self_start.ru_stime);
+    f->maxrss = f->children.ru_maxrss;
+    f->nvcsw = f->children.ru_nvcsw + self.ru_nvcsw - f->self_start.ru_nvcsw;
+    f->nivcsw = f->children.ru_nivcsw + self.ru_nivcsw - f->self_start.ru_nivcsw;
+    f->inblock = f->children.ru_inblock + self.ru_inblock - f->self_start.ru_inblock;
+    f->oublock = f->children.ru_oublock + self.ru_oublock - f->self_start.ru_oublock;
+}
+
+// Charge a reaped child's usage to every open frame
+void acct_add(const struct rusage* ru) {
+    for (acct_frame* f = acct_frames; f != NULL; f = f->prev) {
+        timeradd(&f->children.ru_utime, &ru->ru_utime, &f->children.ru_utime);
+        timeradd(&f->children.ru_stime, &ru->ru_stime, &f->children.ru_stime);
+        if (ru->ru_maxrss > f->children.ru_maxrss) {
+            f->children.ru_maxrss = ru->ru_maxrss;
+        }
+        f->children.ru_nvcsw += ru->ru_nvcsw;
+        f->children.ru_nivcsw += ru->ru_nivcsw;
+        f->children.ru_inblock += ru->ru_inblock;
+        f->children.ru_oublock += ru->ru_oublock;
+    }
+}
+
+// `time` keyword
+
+void acct_timing_begin(acct_frame* f) {
+    acct_begin(f);
+    acct_timing_depth++;
+}
+
+void acct_timing_end(acct_frame* f) {
+    acct_end(f);
+    acct_timing_depth--;
+
+    fprintf(stderr, "\nreal    %.3fs\n", f->real);
+    fprintf(stderr, "user    %.3fs\n", f->user);
+    fprintf(stderr, "sys     %.3fs\n", f->sys);
+    fprintf(stderr, "maxrss  %ld KB\n", f->maxrss);
+    fprintf(stderr, "ctxsw   %ld voluntary, %ld involuntary\n", f->nvcsw, f->nivcsw);
+    fprintf(stderr, "blockio %ld in, %ld out\n", f->inblock, f->oublock);
+}
+
+// True while a `time` is running, so pipelines report each stage
+int acct_timing() {
+    return acct_timing_depth > 0;
+}
+
+void acct_print_stage(int n, const char* name, const struct rusage* ru) {
+    fprintf(stderr, "stage %d %-12s user %.3fs sys %.3fs maxrss %ld KB ctxsw %ld/%ld blockio %ld/%ld\n",
+            n, name, timeval_sec(&ru->ru_utime), timeval_sec(&ru->ru_stime), ru->ru_maxrss,
+            ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_inblock, ru->ru_oublock);
+}
+
+// Per-command log
+
+static int acct_log_open(const char* path) {
+    if (acct_log_fd != -1 && strcmp(acct_log_path, path) == 0) {
+        return acct_log_fd;
+    }
+    if (acct_log_fd != -1) {
+        close(acct_log_fd);
+    }
+    free(acct_log_path);
+    acct_log_path = strdup(path);
+    acct_log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (acct_log_fd == -1) {
+        fprintf(stderr, "myshell: %s: %s\n", path, strerror(errno));
+    }
+    return acct_log_fd;
+}
+
+// Append one tab-separated line for a finished command:
+// epoch real user sys maxrss_kb nvcsw nivcsw inblock oublock status command
+void acct_log(const char* path, const acct_frame* f, int status, const char* cmdline) {
+    int fd = acct_log_open(path);
+    if (fd == -1) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    dprintf(fd, "%ld.%03ld\t%.6f\t%.6f\t%.6f\t%ld\t%ld\t%ld\t%ld\t%ld\t%d\t%s\n",
+            (long)now.tv_sec, now.tv_nsec / 1000000, f->real, f->user, f->sys, f->maxrss,
+            f->nvcsw, f->nivcsw, f->inblock, f->oublock, status, cmdline);
+}
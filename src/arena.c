@@ -0,0 +1,103 @@
+#include "shell.h"
+#include <stddef.h>
+
+// Bump allocator for everything that lives only as long as one command line:
+// the token array and tokens, expansion results, pipeline bookkeeping. The
+// whole command is released with a single arena_reset() once it finishes.
+
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+arena command_arena = {0};
+
+static arena_block* arena_new_block(size_t size) {
+    arena_block* block = malloc(sizeof(arena_block) + size);
+    if (block == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void* arena_alloc(arena* a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    arena_block* block = a->head;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = arena_new_block(block_size);
+        block->next = a->head;
+        a->head = block;
+    }
+
+    void* ptr = (char*)block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char* arena_strndup(arena* a, const char* s, size_t len) {
+    char* copy = arena_alloc(a, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(arena* a, const char* s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+// Free every block but one standard-sized block, which is kept for reuse
+void arena_reset(arena* a) {
+    arena_block* keep = NULL;
+    arena_block* block = a->head;
+    while (block != NULL) {
+        arena_block* next = block->next;
+        if (keep == NULL && block->size == ARENA_BLOCK_SIZE) {
+            keep = block;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    a->head = keep;
+}
+
+// Remember the current allocation point, so that everything allocated after
+// it can be released on its own while earlier allocations stay valid
+arena_mark arena_save(arena* a) {
+    arena_mark mark = {a->head, a->head != NULL ? a->head->used : 0};
+    return mark;
+}
+
+void arena_restore(arena* a, arena_mark mark) {
+    while (a->head != mark.block) {
+        arena_block* next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    if (a->head != NULL) {
+        a->head->used = mark.used;
+    }
+}
+
+void arena_destroy(arena* a) {
+    while (a->head != NULL) {
+        arena_block* next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
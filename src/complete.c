@@ -0,0 +1,386 @@
+#include "shell.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/inotify.h>
+
+// Tab completion: command names in command position, variable names after
+// '$', file names everywhere else.
+//
+// Command names come from the PATH index, a prefix trie holding every
+// executable on PATH (and the builtins). Each name records the first PATH
+// directory that has it, which is the one execvp would run, so the index
+// also answers path_lookup() misses without a stat() per PATH entry.
+//
+// The index is built on the first Tab and then kept current through
+// inotify: each PATH directory is watched, and a binary that appears,
+// disappears or changes mode updates its trie entry and drops its hash
+// cache entry. Events are read by the prompt's event loop, and before any
+// lookup. A new PATH, a queue overflow or a removed directory rebuilds the
+// index on next use.
+
+#define INDEX_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+#define TRIE_BUILTIN 1
+
+// Children of a node are a sibling list sorted by character, so a
+// depth-first walk yields names in sorted order
+typedef struct {
+    int child;
+    int sibling;
+    short dir;   // first PATH directory with this name, or -1
+    unsigned char c;
+    unsigned char flags;
+} trie_node;
+
+typedef struct {
+    char* path;
+    int wd;
+} index_dir;
+
+static trie_node* nodes = NULL;
+static int node_count = 0;
+static int node_capacity = 0;
+
+static index_dir* dirs = NULL;
+static int dir_count = 0;
+static char* index_path_var = NULL;   // PATH the index was built from
+static int index_stale = 1;
+static int inotify_fd = -1;
+
+static const char* builtin_names[] = {
+    "exit", "cd", "help", "jobs", "hash", "history", "export", "unset", "set",
+    "cat", "tee", "cp", "echo", "printf", "test", "true", "false",
+    "if", "then", "elif", "else", "fi", "while", "for", "do", "done", "break", "continue",
+    "time", "meter", "pipesize", "parallel", "pin", "nice", "cg", NULL};
+
+static int trie_new_node(unsigned char c) {
+    if (node_count == node_capacity) {
+        node_capacity = node_capacity ? node_capacity * 2 : 4096;
+        nodes = realloc(nodes, sizeof(trie_node) * node_capacity);
+        if (nodes == NULL) {
+            perror("realloc failed");
+            exit(1);
+        }
+    }
+    trie_node* n = &nodes[node_count];
+    n->child = -1;
+    n->sibling = -1;
+    n->dir = -1;
+    n->c = c;
+    n->flags = 0;
+    return node_count++;
+}
+
+// The node for name, created if create is set; -1 if absent
+static int trie_find(const char* name, size_t len, int create) {
+    int node = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = name[i];
+        int prev = -1;
+        int next = nodes[node].child;
+        while (next != -1 && nodes[next].c < c) {
+            prev = next;
+            next = nodes[next].sibling;
+        }
+        if (next == -1 || nodes[next].c != c) {
+            if (!create) {
+                return -1;
+            }
+            // May move nodes, so links are set by index afterwards
+            int added = trie_new_node(c);
+            nodes[added].sibling = next;
+            if (prev == -1) {
+                nodes[node].child = added;
+            } else {
+                nodes[prev].sibling = added;
+            }
+            next = added;
+        }
+        node = next;
+    }
+    return node;
+}
+
+static int is_executable(int dir, const char* name) {
+    char path[MAX_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dirs[dir].path, name);
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+static void index_clear() {
+    for (int i = 0; i < dir_count; i++) {
+        if (dirs[i].wd != -1) inotify_rm_watch(inotify_fd, dirs[i].wd);
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    dir_count = 0;
+    node_count = 0;
+    trie_new_node('\0');
+}
+
+// Add the executables of PATH directory d that no earlier directory has
+static void index_scan_dir(int d) {
+    DIR* dir = opendir(dirs[d].path);
+    if (dir == NULL) {
+        return;
+    }
+    int fd = dirfd(dir);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' || (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)) {
+            continue;
+        }
+        int node = trie_find(name, strlen(name), 1);
+        if (nodes[node].dir != -1) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(fd, name, &st, 0) == 0 && S_ISREG(st.st_mode) && faccessat(fd, name, X_OK, 0) == 0) {
+            nodes[node].dir = d;
+        }
+    }
+    closedir(dir);
+}
+
+// (Re)build the index if PATH has changed or it is out of date
+int path_index_build() {
+    const char* path = getenv("PATH");
+    if (path == NULL) path = "";
+    if (!index_stale && index_path_var != NULL && strcmp(index_path_var, path) == 0) {
+        return 0;
+    }
+
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    index_clear();
+    free(index_path_var);
+    index_path_var = strdup(path);
+
+    for (const char* p = path; ; ) {
+        const char* end = strchr(p, ':');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        dirs = realloc(dirs, sizeof(index_dir) * (dir_count + 1));
+        dirs[dir_count].path = len == 0 ? strdup(".") : strndup(p, len);
+        dirs[dir_count].wd = inotify_fd == -1 ? -1 :
+            inotify_add_watch(inotify_fd, dirs[dir_count].path, INDEX_EVENTS | IN_ONLYDIR);
+        dir_count++;
+        if (end == NULL) break;
+        p = end + 1;
+    }
+    // Watches go in first, so nothing changes unseen during the scan
+    for (int d = 0; d < dir_count; d++) {
+        index_scan_dir(d);
+    }
+    for (int i = 0; builtin_names[i] != NULL; i++) {
+        nodes[trie_find(builtin_names[i], strlen(builtin_names[i]), 1)].flags |= TRIE_BUILTIN;
+    }
+    index_stale = 0;
+    return 0;
+}
+
+// A file changed in PATH directory d: re-resolve name from d on
+static void index_update(int d, const char* name) {
+    int node = trie_find(name, strlen(name), 0);
+    if (node != -1 && nodes[node].dir != -1 && nodes[node].dir < d) {
+        return;   // shadowed by an earlier directory
+    }
+    if (is_executable(d, name)) {
+        if (node == -1) node = trie_find(name, strlen(name), 1);
+        nodes[node].dir = d;
+    } else if (node != -1 && nodes[node].dir == d) {
+        nodes[node].dir = -1;
+        for (int next = d + 1; next < dir_count; next++) {
+            if (is_executable(next, name)) {
+                nodes[node].dir = next;
+                break;
+            }
+        }
+    } else {
+        return;
+    }
+    path_cache_invalidate(name);
+}
+
+// Apply the queued inotify events. Only the interactive shell reads them;
+// a forked subshell shares the descriptor and would steal them.
+void path_index_refresh() {
+    if (inotify_fd == -1 || index_stale || !interactive) {
+        return;
+    }
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                index_stale = 1;
+                path_cache_clear();
+                continue;
+            }
+            if (ev->len == 0 || index_stale) {
+                continue;
+            }
+            for (int d = 0; d < dir_count; d++) {
+                if (dirs[d].wd == ev->wd) {
+                    index_update(d, ev->name);
+                }
+            }
+        }
+    }
+}
+
+int path_index_fd() {
+    return inotify_fd;
+}
+
+// Resolve name from the index, once it has been built. Returns NULL if it
+// has not been, or does not know the name.
+const char* path_index_lookup(const char* name, char* buf, size_t size) {
+    if (nodes == NULL || index_stale) {
+        return NULL;
+    }
+    path_index_refresh();
+    const char* path = getenv("PATH");
+    if (index_stale || strcmp(index_path_var, path != NULL ? path : "") != 0) {
+        return NULL;
+    }
+    int node = trie_find(name, strlen(name), 0);
+    if (node == -1 || nodes[node].dir == -1) {
+        return NULL;
+    }
+    snprintf(buf, size, "%s/%s", dirs[nodes[node].dir].path, name);
+    return buf;
+}
+
+// Every command name starting with prefix, sorted: a malloc'd,
+// NULL-terminated array of malloc'd names
+char** command_completions(const char* prefix, size_t len) {
+    path_index_build();
+    path_index_refresh();
+    path_index_build();
+
+    size_t count = 0;
+    size_t capacity = 16;
+    char** matches = malloc(sizeof(char*) * capacity);
+    int start = trie_find(prefix, len, 0);
+    if (start == -1) {
+        matches[0] = NULL;
+        return matches;
+    }
+
+    // Depth-first walk below start, with the name so far in word
+    char word[MAX_LEN];
+    int stack[MAX_LEN];
+    memcpy(word, prefix, len);
+    size_t depth = len;
+    int top = 0;
+    int node = start;
+    while (1) {
+        if (nodes[node].dir != -1 || (nodes[node].flags & TRIE_BUILTIN)) {
+            if (count + 1 >= capacity) {
+                capacity *= 2;
+                matches = realloc(matches, sizeof(char*) * capacity);
+            }
+            matches[count++] = strndup(word, depth);
+        }
+        // Down to the first child, else along to the next sibling, climbing
+        // back up as levels run out
+        if (nodes[node].child != -1 && depth < sizeof(word) - 1) {
+            stack[top++] = node;
+            node = nodes[node].child;
+            word[depth++] = nodes[node].c;
+            continue;
+        }
+        while (top > 0 && nodes[node].sibling == -1) {
+            node = stack[--top];
+            depth--;
+        }
+        if (top == 0) {
+            break;
+        }
+        node = nodes[node].sibling;
+        word[depth - 1] = nodes[node].c;
+    }
+    matches[count] = NULL;
+    return matches;
+}
+
+// Turn a sorted match list into readline's form: the longest common prefix
+// first, then the matches (or the single match alone)
+static char** readline_matches(char** names) {
+    size_t count = 0;
+    while (names[count] != NULL) count++;
+    if (count == 0) {
+        free(names);
+        return NULL;
+    }
+    char** matches = malloc(sizeof(char*) * (count + 2));
+    if (count == 1) {
+        matches[0] = names[0];
+        matches[1] = NULL;
+    } else {
+        size_t common = 0;
+        const char* first = names[0];
+        const char* last = names[count - 1];
+        while (first[common] != '\0' && first[common] == last[common]) common++;
+        matches[0] = strndup(first, common);
+        memcpy(matches + 1, names, sizeof(char*) * (count + 1));
+    }
+    free(names);
+    return matches;
+}
+
+// Whether the word at start is in command position: first on the line or
+// after |, ;, &, ( or a keyword that takes a command
+static int is_command_position(int start) {
+    static const char* leaders[] = {"then", "else", "elif", "do", "if", "while", "time", "meter",
+                                    "parallel", "nice", NULL};
+    int i = start - 1;
+    while (i >= 0 && (rl_line_buffer[i] == ' ' || rl_line_buffer[i] == '\t')) i--;
+    if (i < 0 || strchr("|;&(", rl_line_buffer[i]) != NULL) {
+        return 1;
+    }
+    int end = i + 1;
+    while (i >= 0 && rl_line_buffer[i] != ' ' && rl_line_buffer[i] != '\t') i--;
+    for (int k = 0; leaders[k] != NULL; k++) {
+        size_t len = strlen(leaders[k]);
+        if ((size_t)(end - i - 1) == len && strncmp(rl_line_buffer + i + 1, leaders[k], len) == 0) {
+            return is_command_position(i + 1);
+        }
+    }
+    return 0;
+}
+
+static char** shell_completion(const char* text, int start, int end) {
+    (void)end;
+    rl_sort_completion_matches = 1;
+
+    // $NAME and ${NAME}; '$' and '{' are word breaks, so text is the name
+    int brace = start > 1 && rl_line_buffer[start - 1] == '{' && rl_line_buffer[start - 2] == '$';
+    if (brace || (start > 0 && rl_line_buffer[start - 1] == '$')) {
+        rl_attempted_completion_over = 1;
+        rl_completion_append_character = brace ? '}' : ' ';
+        return readline_matches(var_names_with_prefix(text, strlen(text)));
+    }
+
+    // Like bash's no_empty_cmd_completion: Tab on nothing lists files
+    if (text[0] != '\0' && strchr(text, '/') == NULL && is_command_position(start)) {
+        char** matches = readline_matches(command_completions(text, strlen(text)));
+        if (matches != NULL) {
+            // Already sorted and unique
+            rl_sort_completion_matches = 0;
+            rl_attempted_completion_over = 1;
+            return matches;
+        }
+    }
+    return NULL;   // file names
+}
+
+void completion_init() {
+    rl_attempted_completion_function = shell_completion;
+}
@@ -0,0 +1,388 @@
+#include "shell.h"
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+
+// cat, tee and cp as stream builtins. Data is moved inside the kernel
+// wherever the descriptor types allow it: copy_file_range between regular
+// files, sendfile out of a regular file and splice to or from a pipe. Other
+// combinations (terminals, sockets, O_APPEND targets on older kernels) fall
+// back to a read/write loop.
+
+#define COPY_CHUNK (1 << 30)
+#define COPY_BUFFER_SIZE (128 * 1024)
+#define COPY_UNSUPPORTED -2
+
+enum { COPY_RANGE, COPY_SENDFILE, COPY_SPLICE };
+
+// Set with every failed copy: whether it was the input that failed
+static int copy_failed_input = 0;
+
+// The kernel copies do not say which side failed; these can only be the
+// output's doing
+static int copy_output_errno(int err) {
+    return err == EPIPE || err == ENOSPC || err == EDQUOT || err == EFBIG;
+}
+
+static int copy_read_write(int in, int out) {
+    static char* buf = NULL;
+    if (buf == NULL) {
+        buf = malloc(COPY_BUFFER_SIZE);
+    }
+
+    while (1) {
+        ssize_t n = read(in, buf, COPY_BUFFER_SIZE);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            copy_failed_input = 1;
+            return -1;
+        }
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out, buf + done, n - done);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                copy_failed_input = 0;
+                return -1;
+            }
+            done += w;
+        }
+    }
+}
+
+// Errors meaning "this descriptor pair cannot use that system call"
+static int copy_declined(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+// Copy with one zero-copy method until end of input. Returns
+// COPY_UNSUPPORTED if the kernel declines before any data has moved.
+static int copy_kernel(int in, int out, int method) {
+    int moved = 0;
+    while (1) {
+        ssize_t n;
+        switch (method) {
+            case COPY_RANGE:
+                n = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+                break;
+            case COPY_SENDFILE:
+                n = sendfile(out, in, NULL, COPY_CHUNK);
+                break;
+            default:
+                n = splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE);
+                break;
+        }
+        if (n > 0) {
+            moved = 1;
+            continue;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (copy_declined(errno)) {
+            // Offsets have advanced past what was copied, so the plain loop
+            // can carry on from here
+            return moved ? copy_read_write(in, out) : COPY_UNSUPPORTED;
+        }
+        copy_failed_input = !copy_output_errno(errno);
+        return -1;
+    }
+}
+
+// Copy everything from in to out. Returns 0, or -1 with errno set and
+// copy_failed_input saying which side failed.
+int copy_fd(int in, int out) {
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) == -1) {
+        copy_failed_input = 1;
+        return -1;
+    }
+    if (fstat(out, &out_st) == -1) {
+        copy_failed_input = 0;
+        return -1;
+    }
+
+    // Pseudo files such as those in /proc report a size of 0 and only
+    // produce data through read()
+    int in_file = S_ISREG(in_st.st_mode) && in_st.st_size > 0;
+    int out_file = S_ISREG(out_st.st_mode);
+    int out_pipe = S_ISFIFO(out_st.st_mode);
+    int any_pipe = S_ISFIFO(in_st.st_mode) || out_pipe;
+
+    // sendfile into a pipe goes through an internal pipe of its own, so
+    // splice directly when the output already is one
+    int result = COPY_UNSUPPORTED;
+    if (in_file && out_file) {
+        result = copy_kernel(in, out, COPY_RANGE);
+    }
+    if (result == COPY_UNSUPPORTED && out_pipe) {
+        result = copy_kernel(in, out, COPY_SPLICE);
+    }
+    if (result == COPY_UNSUPPORTED && in_file) {
+        result = copy_kernel(in, out, COPY_SENDFILE);
+    }
+    if (result == COPY_UNSUPPORTED && any_pipe) {
+        result = copy_kernel(in, out, COPY_SPLICE);
+    }
+    if (result == COPY_UNSUPPORTED) {
+        result = copy_read_write(in, out);
+    }
+    return result;
+}
+
+// Report a failed copy the way the builtin's caller expects: a vanished
+// reader ends the command as SIGPIPE would, anything else is an error.
+// input names what was being read, or is NULL for standard input.
+static int copy_error(const char* name, const char* input, stdio_fds* io) {
+    if (copy_failed_input) {
+        if (input != NULL) {
+            dprintf(io->fd[STDERR_FILENO], "%s: %s: read error: %s\n", name, input, strerror(errno));
+        } else {
+            dprintf(io->fd[STDERR_FILENO], "%s: read error: %s\n", name, strerror(errno));
+        }
+        return 1;
+    }
+    if (errno == EPIPE) {
+        return 128 + SIGPIPE;
+    }
+    dprintf(io->fd[STDERR_FILENO], "%s: write error: %s\n", name, strerror(errno));
+    return 1;
+}
+
+// Copy one input of cat to its output. A regular file that is also the
+// output is refused: appending it to itself would never reach its end.
+static int cat_fd(int fd, const char* name, const struct stat* out_st, stdio_fds* io) {
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        if (S_ISDIR(st.st_mode)) {
+            dprintf(io->fd[STDERR_FILENO], "cat: %s: %s\n", name, strerror(EISDIR));
+            return 1;
+        }
+        if (out_st != NULL && S_ISREG(st.st_mode) && st.st_dev == out_st->st_dev && st.st_ino == out_st->st_ino) {
+            dprintf(io->fd[STDERR_FILENO], "cat: %s: input file is output file\n", name);
+            return 1;
+        }
+    }
+    if (copy_fd(fd, io->fd[STDOUT_FILENO]) == -1) {
+        return copy_error("cat", fd == io->fd[STDIN_FILENO] ? NULL : name, io);
+    }
+    return 0;
+}
+
+// cat [file...]
+int builtin_cat(char** argv, stdio_fds* io) {
+    struct stat out_st;
+    const struct stat* out = fstat(io->fd[STDOUT_FILENO], &out_st) == 0 ? &out_st : NULL;
+    int status = 0;
+    int i = 1;
+    if (argv[i] != NULL && strcmp(argv[i], "--") == 0) i++;
+
+    if (argv[i] == NULL) {
+        return cat_fd(io->fd[STDIN_FILENO], "-", out, io);
+    }
+
+    for (; argv[i] != NULL; i++) {
+        int fd = io->fd[STDIN_FILENO];
+        if (strcmp(argv[i], "-") != 0) {
+            fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                dprintf(io->fd[STDERR_FILENO], "cat: %s: %s\n", argv[i], strerror(errno));
+                status = 1;
+                continue;
+            }
+        }
+        int result = cat_fd(fd, argv[i], out, io);
+        if (fd != io->fd[STDIN_FILENO]) {
+            close(fd);
+        }
+        if (result == 128 + SIGPIPE) {
+            return result;
+        }
+        if (result != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// tee with a single file between two pipes: duplicate the data into the
+// output pipe with tee(2), then splice the same bytes into the file
+static int tee_pipes(int in, int out, int file) {
+    while (1) {
+        ssize_t n = tee(in, out, COPY_CHUNK, 0);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            copy_failed_input = !copy_output_errno(errno);
+            return copy_declined(errno) ? COPY_UNSUPPORTED : -1;
+        }
+        while (n > 0) {
+            ssize_t m = splice(in, NULL, file, NULL, n, SPLICE_F_MOVE);
+            if (m < 0) {
+                if (errno == EINTR) continue;
+                copy_failed_input = 0;
+                return -1;
+            }
+            n -= m;
+        }
+    }
+}
+
+// tee [-a] [file...]
+int builtin_tee(char** argv, stdio_fds* io) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    }
+
+    int status = 0;
+    int count = 0;
+    int files = 0;
+    while (argv[i + files] != NULL) files++;
+    int* outs = arena_alloc(&command_arena, sizeof(int) * (files + 1));
+    outs[count++] = io->fd[STDOUT_FILENO];
+    for (; argv[i] != NULL; i++) {
+        int fd = open(argv[i], flags, 0666);
+        if (fd == -1) {
+            dprintf(io->fd[STDERR_FILENO], "tee: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[count++] = fd;
+    }
+
+    int in = io->fd[STDIN_FILENO];
+    int result = COPY_UNSUPPORTED;
+    struct stat in_st, out_st, file_st;
+    if (count == 1) {
+        result = copy_fd(in, outs[0]);
+    } else if (count == 2 && fstat(in, &in_st) == 0 && fstat(outs[0], &out_st) == 0 &&
+               fstat(outs[1], &file_st) == 0 && S_ISFIFO(in_st.st_mode) &&
+               S_ISFIFO(out_st.st_mode) && S_ISREG(file_st.st_mode) && !(flags & O_APPEND)) {
+        result = tee_pipes(in, outs[0], outs[1]);
+    }
+
+    // General case: read once, write to every output
+    if (result == COPY_UNSUPPORTED) {
+        char* buf = malloc(COPY_BUFFER_SIZE);
+        result = 0;
+        while (result == 0) {
+            ssize_t n = read(in, buf, COPY_BUFFER_SIZE);
+            if (n == 0) break;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                copy_failed_input = 1;
+                result = -1;
+                break;
+            }
+            for (int j = 0; j < count && result == 0; j++) {
+                for (ssize_t done = 0; done < n;) {
+                    ssize_t w = write(outs[j], buf + done, n - done);
+                    if (w < 0) {
+                        if (errno == EINTR) continue;
+                        copy_failed_input = 0;
+                        result = -1;
+                        break;
+                    }
+                    done += w;
+                }
+            }
+        }
+        free(buf);
+    }
+
+    if (result == -1) {
+        status = copy_error("tee", NULL, io);
+    }
+    for (int j = 1; j < count; j++) {
+        close(outs[j]);
+    }
+    return status;
+}
+
+static int cp_file(const char* src, const char* dst, stdio_fds* io) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        dprintf(io->fd[STDERR_FILENO], "cp: cannot stat '%s': %s\n", src, strerror(errno));
+        return 1;
+    }
+    struct stat in_st, out_st;
+    fstat(in, &in_st);
+    if (S_ISDIR(in_st.st_mode)) {
+        dprintf(io->fd[STDERR_FILENO], "cp: -r not specified; omitting directory '%s'\n", src);
+        close(in);
+        return 1;
+    }
+    if (stat(dst, &out_st) == 0 && out_st.st_dev == in_st.st_dev && out_st.st_ino == in_st.st_ino) {
+        dprintf(io->fd[STDERR_FILENO], "cp: '%s' and '%s' are the same file\n", src, dst);
+        close(in);
+        return 1;
+    }
+
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, in_st.st_mode & 0777);
+    if (out == -1) {
+        dprintf(io->fd[STDERR_FILENO], "cp: cannot create '%s': %s\n", dst, strerror(errno));
+        close(in);
+        return 1;
+    }
+
+    int status = 0;
+    if (copy_fd(in, out) == -1) {
+        dprintf(io->fd[STDERR_FILENO], "cp: error copying '%s' to '%s': %s\n", src, dst, strerror(errno));
+        status = 1;
+    }
+    close(in);
+    if (close(out) == -1 && status == 0) {
+        dprintf(io->fd[STDERR_FILENO], "cp: error writing '%s': %s\n", dst, strerror(errno));
+        status = 1;
+    }
+    return status;
+}
+
+// cp SOURCE DEST, or cp SOURCE... DIRECTORY
+int builtin_cp(char** argv, stdio_fds* io) {
+    int first = 1;
+    if (argv[first] != NULL && strcmp(argv[first], "--") == 0) first++;
+
+    int count = 0;
+    while (argv[first + count] != NULL) count++;
+    if (count < 2) {
+        dprintf(io->fd[STDERR_FILENO], "cp: missing file operand\n");
+        return 1;
+    }
+
+    const char* dest = argv[first + count - 1];
+    struct stat st;
+    int dest_is_dir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+    if (count > 2 && !dest_is_dir) {
+        dprintf(io->fd[STDERR_FILENO], "cp: target '%s' is not a directory\n", dest);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = first; i < first + count - 1; i++) {
+        if (!dest_is_dir) {
+            status |= cp_file(argv[i], dest, io);
+            continue;
+        }
+        char* copy = arena_strdup(&command_arena, argv[i]);
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dest, basename(copy));
+        status |= cp_file(argv[i], path, io);
+    }
+    return status;
+}
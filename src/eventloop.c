@@ -0,0 +1,249 @@
+#include "shell.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// Interactive line input.
+//
+// Instead of blocking in readline(), the prompt runs readline's callback
+// interface from an epoll loop over four descriptors:
+//
+//   stdin      a key is ready: rl_callback_read_char()
+//   signalfd   SIGCHLD, SIGINT and SIGWINCH, blocked while the prompt is up
+//   timerfd    the TMOUT idle timeout, re-armed on every key
+//   inotify    PATH directories changed: update the completion index
+//
+// So a background job that finishes is reported the moment it exits, above
+// the line being edited; Ctrl-C abandons the line; a resized terminal is
+// redrawn; and the shell sleeps in epoll_wait() while nothing happens.
+// Key bindings that read further keys themselves (Ctrl-R) wait in the same
+// loop through event_read_key().
+
+enum { EVENT_INPUT, EVENT_SIGNAL, EVENT_TIMEOUT, EVENT_PATH };
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static int timeout_fd = -1;
+static int path_fd = -1;
+static sigset_t prompt_signals;
+
+static char* accepted_line = NULL;
+static int line_done = 0;
+static int timed_out = 0;
+
+static int event_watch(int fd, int tag) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Readline is only set up once a prompt is actually needed, so scripts and
+// -c commands never pay for it
+void readline_init() {
+    static int ready = 0;
+    if (ready) {
+        return;
+    }
+    ready = 1;
+    rl_readline_name = "myshell";
+    rl_bind_key('\t', rl_complete);
+    rl_bind_key(CTRL('R'), history_search_key);
+    completion_init();
+    rl_initialize();
+}
+
+static int event_init() {
+    if (epoll_fd != -1) {
+        return 0;
+    }
+    readline_init();
+    sigemptyset(&prompt_signals);
+    sigaddset(&prompt_signals, SIGCHLD);
+    sigaddset(&prompt_signals, SIGINT);
+    sigaddset(&prompt_signals, SIGWINCH);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &prompt_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    timeout_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd == -1 || signal_fd == -1 || timeout_fd == -1 ||
+        event_watch(STDIN_FILENO, EVENT_INPUT) == -1 || event_watch(signal_fd, EVENT_SIGNAL) == -1 ||
+        event_watch(timeout_fd, EVENT_TIMEOUT) == -1) {
+        perror("event loop");
+        return -1;
+    }
+
+    // The loop handles these signals itself
+    rl_catch_signals = 0;
+    rl_catch_sigwinch = 0;
+    return 0;
+}
+
+// Arm the idle timer from TMOUT (seconds), or disarm it
+static void event_arm_timeout() {
+    const char* tmout = var_get("TMOUT");
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (tmout != NULL) {
+        spec.it_value.tv_sec = atol(tmout);
+    }
+    timerfd_settime(timeout_fd, 0, &spec, NULL);
+}
+
+static void line_handler(char* line) {
+    accepted_line = line;
+    line_done = 1;
+    rl_callback_handler_remove();
+}
+
+enum { SIGNALS_DONE, SIGNALS_EDITING, SIGNALS_KEY };
+
+// Handle every signal queued on the signalfd. Once the line is done only
+// finished jobs still matter; while a key binding reads keys, Ctrl-C is
+// left to it. Returns 1 if Ctrl-C was left.
+static int event_signals(int mode) {
+    struct signalfd_siginfo info;
+    int interrupted = 0;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (mode == SIGNALS_DONE) {
+            if (info.ssi_signo == SIGCHLD) cleanup_background_jobs();
+            continue;
+        }
+        switch (info.ssi_signo) {
+            case SIGCHLD:
+                jobs_report_at_prompt();
+                break;
+            case SIGINT:
+                if (mode == SIGNALS_KEY) {
+                    interrupted = 1;
+                    break;
+                }
+                // Abandon the line and start over on a fresh prompt
+                rl_free_line_state();
+                rl_callback_sigcleanup();
+                rl_replace_line("", 0);
+                rl_crlf();
+                rl_on_new_line();
+                rl_redisplay();
+                break;
+            case SIGWINCH:
+                rl_resize_terminal();
+                break;
+        }
+    }
+    return interrupted;
+}
+
+// Whether TMOUT has expired
+static int event_expired() {
+    uint64_t expirations;
+    return read(timeout_fd, &expirations, sizeof(expirations)) > 0;
+}
+
+// The next key for a binding that reads keys itself, serving the other
+// descriptors as the prompt does while it waits. Ctrl-C reads as Ctrl-G
+// (abort) and an expired TMOUT as end of input, after which the prompt
+// logs out.
+int event_read_key() {
+    if (epoll_fd == -1 || rl_pending_input) {
+        return rl_read_key();
+    }
+    while (1) {
+        struct epoll_event events[4];
+        int n = epoll_wait(epoll_fd, events, 4, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return rl_read_key();
+        }
+        for (int i = 0; i < n; i++) {
+            switch (events[i].data.u32) {
+                case EVENT_INPUT:
+                    event_arm_timeout();
+                    return rl_read_key();
+                case EVENT_SIGNAL:
+                    if (event_signals(SIGNALS_KEY)) {
+                        return CTRL('G');
+                    }
+                    break;
+                case EVENT_PATH:
+                    path_index_refresh();
+                    break;
+                case EVENT_TIMEOUT:
+                    if (event_expired()) {
+                        timed_out = 1;
+                        return EOF;
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+// Read one line at the terminal. Returns a malloc'd line, or NULL at end of
+// input (Ctrl-D) or when TMOUT expires.
+char* event_read_line(const char* prompt) {
+    if (event_init() == -1) {
+        return readline(prompt);
+    }
+
+    sigset_t saved;
+    sigprocmask(SIG_BLOCK, &prompt_signals, &saved);
+
+    // Jobs that finished while the last command ran are reported first
+    cleanup_background_jobs();
+
+    // The PATH index exists from the first completion on
+    if (path_fd == -1 && path_index_fd() != -1 && event_watch(path_index_fd(), EVENT_PATH) == 0) {
+        path_fd = path_index_fd();
+    }
+    path_index_refresh();
+
+    line_done = 0;
+    timed_out = 0;
+    accepted_line = NULL;
+    rl_callback_handler_install(prompt, line_handler);
+    event_arm_timeout();
+
+    while (!line_done) {
+        struct epoll_event events[4];
+        int n = epoll_wait(epoll_fd, events, 4, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n && !line_done; i++) {
+            switch (events[i].data.u32) {
+                case EVENT_INPUT:
+                    rl_callback_read_char();
+                    event_arm_timeout();
+                    break;
+                case EVENT_SIGNAL:
+                    event_signals(SIGNALS_EDITING);
+                    break;
+                case EVENT_PATH:
+                    path_index_refresh();
+                    break;
+                case EVENT_TIMEOUT:
+                    timed_out = event_expired();
+                    break;
+            }
+            if (timed_out && !line_done) {
+                printf("\ntimed out waiting for input: auto-logout\n");
+                rl_callback_handler_remove();
+                line_done = 1;
+            }
+        }
+    }
+
+    // Nothing queued may reach the default handlers once unblocked
+    event_signals(SIGNALS_DONE);
+    struct itimerspec off;
+    memset(&off, 0, sizeof(off));
+    timerfd_settime(timeout_fd, 0, &off, NULL);
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    return accepted_line;
+}
@@ -1,450 +1,284 @@
 #include "shell.h"
 
-// Global history variables
-char* history[HISTORY_SIZE] = {0};
-int history_count = 0;
+// Exit status of the last command, returned by the shell in script mode
+int last_status = 0;
 
-// Global job control variables
-pid_t background_jobs[MAX_JOBS] = {0};
-char* job_commands[MAX_JOBS] = {0};
-int job_count = 0;
-
-// Global variable storage
-char* var_names[MAX_VARS] = {0};
-char* var_values[MAX_VARS] = {0};
-int var_count = 0;
-
-// Check if command is a variable assignment
-int is_variable_assignment(char** arglist) {
-    if (arglist[0] == NULL) {
-        return 0;
-    }
-    
-    char* cmd = arglist[0];
-    char* equal_sign = strchr(cmd, '=');
-    
-    // Must have = sign and it shouldn't be the first character
-    if (equal_sign == NULL || equal_sign == cmd) {
-        return 0;
-    }
-    
-    // Check that the part before = is a valid variable name
-    char* var_name = cmd;
-    int name_len = equal_sign - cmd;
+int handle_background(char** arglist) {
+    int background = 0;
+    int last_index = 0;
     
-    for (int i = 0; i < name_len; i++) {
-        if (!isalnum(var_name[i]) && var_name[i] != '_') {
-            return 0; // Invalid character in variable name
-        }
+    for (int i = 0; arglist[i] != NULL; i++) {
+        last_index = i;
     }
     
-    // Variable name cannot start with a number
-    if (isdigit(var_name[0])) {
-        return 0;
+    if (last_index >= 0 && strcmp(arglist[last_index], "&") == 0) {
+        background = 1;
+        arglist[last_index] = NULL;
     }
     
-    return 1; // Valid variable assignment
+    return background;
 }
 
-// Handle variable assignment
-void handle_variables(char** arglist) {
-    if (arglist[0] == NULL) return;
-    
-    char* assignment = arglist[0];
-    char* equal_sign = strchr(assignment, '=');
-    if (equal_sign == NULL) return;
-    
-    *equal_sign = '\0';
-    char* var_name = assignment;
-    char* var_value = equal_sign + 1;
-    
-    // Proper quote handling - remove surrounding quotes only
-    char* final_value;
-    if (var_value[0] == '"' && var_value[strlen(var_value)-1] == '"' && strlen(var_value) > 1) {
-        // Create a new string without the quotes
-        final_value = malloc(strlen(var_value) - 1);
-        if (final_value) {
-            strncpy(final_value, var_value + 1, strlen(var_value) - 2);
-            final_value[strlen(var_value) - 2] = '\0';
-        } else {
-            final_value = strdup(""); // Fallback if malloc fails
-        }
-    } else {
-        final_value = strdup(var_value); // Make a copy
-    }
+int handle_redirection(char** arglist) {
+    spawn_actions actions;
+    spawn_actions_init(&actions);
     
-    if (!final_value) return; // Memory allocation failed
+    redirection_actions(arglist, &actions);
+    int result = spawn_actions_apply(&actions);
     
-    // Update existing or add new
-    for (int i = 0; i < var_count; i++) {
-        if (strcmp(var_names[i], var_name) == 0) {
-            free(var_values[i]);
-            var_values[i] = final_value;
-            return;
+    spawn_actions_free(&actions);
+    return result;
+}
+
+int handle_pipe(char** arglist) {
+    int stage_count = 1;
+    
+    for (int i = 0; arglist[i] != NULL; i++) {
+        if (strcmp(arglist[i], "|") == 0) {
+            stage_count++;
         }
     }
     
-    // Add new variable
-    if (var_count < MAX_VARS) {
-        var_names[var_count] = strdup(var_name);
-        var_values[var_count] = final_value;
-        var_count++;
-    } else {
-        printf("Maximum variables reached (%d)\n", MAX_VARS);
-        free(final_value);
+    if (stage_count == 1) {
+        return 0;
     }
-}
-
-// Expand variables in arguments
-void expand_variables(char** arglist) {
+    uint64_t trace_start_ns = trace_enabled ? trace_now() : 0;
+    
+    // Split the argument list into stages in place
+    char*** stages = arena_alloc(&command_arena, sizeof(char**) * stage_count);
+    pid_t* pids = arena_alloc(&command_arena, sizeof(pid_t) * stage_count);
+    int* stage_in = arena_alloc(&command_arena, sizeof(int) * stage_count);
+    int* stage_out = arena_alloc(&command_arena, sizeof(int) * stage_count);
+    int* relay_in = arena_alloc(&command_arena, sizeof(int) * stage_count);
+    int* relay_out = arena_alloc(&command_arena, sizeof(int) * stage_count);
+    
+    int stage = 0;
+    stages[stage++] = arglist;
     for (int i = 0; arglist[i] != NULL; i++) {
-        char* arg = arglist[i];
-        
-        // Check if this argument starts with $ and has more characters
-        if (arg[0] == '$' && strlen(arg) > 1) {
-            char* var_name = arg + 1; // Skip the $
-            
-            // Extract clean variable name (alphanumeric and underscore only)
-            char clean_var_name[ARGLEN] = {0};
-            int j = 0;
-            while (var_name[j] != '\0' && j < ARGLEN - 1) {
-                if (isalnum(var_name[j]) || var_name[j] == '_') {
-                    clean_var_name[j] = var_name[j];
-                    j++;
-                } else {
-                    break; // Stop at first non-alphanumeric character
-                }
-            }
-            clean_var_name[j] = '\0';
-            
-            // Skip if variable name is empty
-            if (strlen(clean_var_name) == 0) {
-                continue;
-            }
-            
-            char* new_value = NULL;
-            
-            // Check environment variables first
-            char* env_value = getenv(clean_var_name);
-            if (env_value != NULL) {
-                new_value = strdup(env_value);
-            } else {
-                // Check shell variables
-                for (int k = 0; k < var_count; k++) {
-                    if (strcmp(var_names[k], clean_var_name) == 0) {
-                        new_value = strdup(var_values[k]);
-                        break;
-                    }
-                }
-            }
-            
-            // If we found a value, replace the argument
-            if (new_value != NULL) {
-                free(arglist[i]);
-                arglist[i] = new_value;
-            }
-            // If variable not found, leave it as $VAR (don't replace)
+        if (strcmp(arglist[i], "|") == 0) {
+            arglist[i] = NULL;
+            stages[stage++] = &arglist[i + 1];
         }
     }
-}
-
-// Print variables
-void print_variables() {
-    if (var_count == 0) {
-        printf("No shell variables defined\n");
-    } else {
-        printf("Shell variables:\n");
-        for (int i = 0; i < var_count; i++) {
-            printf("  %s=%s\n", var_names[i], var_values[i]);
+    
+    for (int i = 0; i < stage_count; i++) {
+        if (stages[i][0] == NULL) {
+            fprintf(stderr, "Syntax error: empty command in pipe\n");
+            last_status = 2;
+            return -1;
         }
     }
     
-    // Also show some important environment variables
-    printf("\nEnvironment variables:\n");
-    char* important_vars[] = {"HOME", "PATH", "USER", "SHELL", "PWD", NULL};
-    for (int i = 0; important_vars[i] != NULL; i++) {
-        char* value = getenv(important_vars[i]);
-        if (value != NULL) {
-            printf("  %s=%s\n", important_vars[i], value);
+    // Create all pipes up front. O_CLOEXEC keeps every child from holding
+    // the other stages' ends open; dup2 clears the flag on the copies it makes.
+    // When metering, each boundary gets a second pipe and the shell relays
+    // between the two.
+    int metered = pipe_metering();
+    stage_in[0] = -1;
+    stage_out[stage_count - 1] = -1;
+    for (int i = 0; i < stage_count - 1; i++) {
+        int fds[2], relay_fds[2];
+        int failed = pipe_open(fds) == -1;
+        if (!failed && metered && pipe_open(relay_fds) == -1) {
+            close(fds[0]);
+            close(fds[1]);
+            failed = 1;
         }
-    }
-}
-
-// DEBUG: Print all variables for debugging
-void debug_print_variables() {
-    printf("DEBUG - Current variables (%d):\n", var_count);
-    for (int i = 0; i < var_count; i++) {
-        printf("  [%d] %s='%s' (len=%zu)\n", i, var_names[i], var_values[i], strlen(var_values[i]));
-    }
-}
-
-void cleanup_background_jobs() {
-    int status;
-    pid_t pid;
-    
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        for (int i = 0; i < job_count; i++) {
-            if (background_jobs[i] == pid) {
-                printf("[%d] Done    %d %s\n", i+1, pid, job_commands[i]);
-                
-                free(job_commands[i]);
-                
-                for (int j = i; j < job_count - 1; j++) {
-                    background_jobs[j] = background_jobs[j+1];
-                    job_commands[j] = job_commands[j+1];
+        if (failed) {
+            perror("pipe failed");
+            for (int j = 0; j < i; j++) {
+                close(stage_out[j]);
+                close(stage_in[j + 1]);
+                if (metered) {
+                    close(relay_in[j]);
+                    close(relay_out[j]);
                 }
-                job_count--;
-                background_jobs[job_count] = 0;
-                job_commands[job_count] = NULL;
-                break;
             }
+            last_status = 1;
+            return -1;
         }
-    }
-}
-
-void print_jobs() {
-    if (job_count == 0) {
-        printf("No background jobs\n");
-        return;
-    }
-    
-    for (int i = 0; i < job_count; i++) {
-        int status;
-        pid_t result = waitpid(background_jobs[i], &status, WNOHANG);
-        if (result == 0) {
-            printf("[%d] Running %d %s\n", i+1, background_jobs[i], job_commands[i]);
-        } else if (result > 0) {
-            printf("[%d] Done    %d %s\n", i+1, background_jobs[i], job_commands[i]);
+        stage_out[i] = fds[1];
+        if (metered) {
+            relay_in[i] = fds[0];
+            relay_out[i] = relay_fds[1];
+            stage_in[i + 1] = relay_fds[0];
         } else {
-            printf("[%d] Unknown %d %s\n", i+1, background_jobs[i], job_commands[i]);
+            stage_in[i + 1] = fds[0];
         }
     }
-}
-
-int handle_background(char** arglist) {
-    int background = 0;
-    int last_index = 0;
-    
-    for (int i = 0; arglist[i] != NULL; i++) {
-        last_index = i;
-    }
     
-    if (last_index >= 0 && strcmp(arglist[last_index], "&") == 0) {
-        background = 1;
-        arglist[last_index] = NULL;
-    }
-    
-    return background;
-}
-
-int parse_redirection(char** arglist, char** input_file, char** output_file) {
-    *input_file = NULL;
-    *output_file = NULL;
-    
-    for (int i = 0; arglist[i] != NULL; i++) {
-        if (strcmp(arglist[i], "<") == 0) {
-            *input_file = arglist[i+1];
-            arglist[i] = NULL;
-            if (arglist[i+1]) arglist[i+1] = NULL;
+    // Spawn every stage before waiting on any of them. The pipe ends are
+    // dup'ed first so that per-stage < and > override them. The first
+    // stream builtin runs in the shell itself once the rest are started
+    // (unless the shell is busy relaying); its pipe ends stay open until then.
+    spawn_actions actions;
+    spawn_actions_init(&actions);
+    int* stage_of = arena_alloc(&command_arena, sizeof(int) * stage_count);
+    int spawned = 0;
+    int inproc = -1;
+    int inproc_failed = 0;
+    stream_builtin_fn inproc_fn = NULL;
+    stdio_fds inproc_io;
+    for (int i = 0; i < stage_count; i++) {
+        spawn_actions_reset(&actions);
+        if (stage_in[i] != -1) {
+            spawn_add_dup2(&actions, stage_in[i], STDIN_FILENO);
         }
-        else if (strcmp(arglist[i], ">") == 0) {
-            *output_file = arglist[i+1];
-            arglist[i] = NULL;
-            if (arglist[i+1]) arglist[i+1] = NULL;
+        if (stage_out[i] != -1) {
+            spawn_add_dup2(&actions, stage_out[i], STDOUT_FILENO);
         }
-    }
-    return 0;
-}
-
-int handle_redirection(char** arglist) {
-    char* input_file = NULL;
-    char* output_file = NULL;
-    
-    parse_redirection(arglist, &input_file, &output_file);
-    
-    if (input_file != NULL) {
-        int fd = open(input_file, O_RDONLY);
-        if (fd == -1) {
-            perror("Input redirection failed");
-            return -1;
+        int redirected = redirection_actions(stages[i], &actions) == 0;
+        
+        stream_builtin_fn fn = redirected ? stream_builtin_find(stages[i]) : NULL;
+        if (fn != NULL && inproc == -1 && !metered && !placement_active()) {
+            inproc = i;
+            inproc_fn = fn;
+            inproc_failed = stdio_fds_open(&inproc_io, &actions) == -1;
+            continue;
         }
-        if (dup2(fd, STDIN_FILENO) == -1) {
-            perror("dup2 input failed");
-            close(fd);
-            return -1;
+        
+        pid_t pid = !redirected ? -1
+                    : fn != NULL ? spawn_stream_builtin(fn, stages[i], &actions)
+                                 : spawn_process(stages[i], &actions);
+        if (pid > 0) {
+            stage_of[spawned] = i;
+            pids[spawned++] = pid;
         }
-        close(fd);
-    }
-    
-    if (output_file != NULL) {
-        int fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd == -1) {
-            perror("Output redirection failed");
-            return -1;
+        
+        // The parent no longer needs the ends this stage consumed
+        if (stage_in[i] != -1) {
+            close(stage_in[i]);
         }
-        if (dup2(fd, STDOUT_FILENO) == -1) {
-            perror("dup2 output failed");
-            close(fd);
-            return -1;
+        if (stage_out[i] != -1) {
+            close(stage_out[i]);
         }
-        close(fd);
     }
+    spawn_actions_free(&actions);
     
-    return 0;
-}
-
-int handle_pipe(char** arglist) {
-    int pipe_pos = -1;
-    
-    for (int i = 0; arglist[i] != NULL; i++) {
-        if (strcmp(arglist[i], "|") == 0) {
-            pipe_pos = i;
-            break;
+    int inproc_status = 1;
+    if (inproc >= 0) {
+        if (!inproc_failed) {
+            inproc_status = stream_builtin_call(inproc_fn, stages[inproc], &inproc_io);
+            stdio_fds_close(&inproc_io);
+        }
+        if (stage_in[inproc] != -1) {
+            close(stage_in[inproc]);
+        }
+        if (stage_out[inproc] != -1) {
+            close(stage_out[inproc]);
         }
     }
     
-    if (pipe_pos == -1) {
-        return 0;
+    pipe_meter* meter = NULL;
+    if (metered) {
+        meter = pipe_meter_relay(stage_count, relay_in, relay_out);
     }
     
-    arglist[pipe_pos] = NULL;
-    char** left_cmd = arglist;
-    char** right_cmd = &arglist[pipe_pos + 1];
-    
-    if (right_cmd[0] == NULL) {
-        fprintf(stderr, "Syntax error: no command after pipe\n");
-        return -1;
+    // Reap all stages in a single pass; the pipeline's status is the last stage's
+    int* statuses = arena_alloc(&command_arena, sizeof(int) * stage_count);
+    struct rusage* usages = arena_alloc(&command_arena, sizeof(struct rusage) * stage_count);
+    wait_for_children(pids, statuses, usages, spawned);
+    if (meter != NULL) {
+        pipe_meter_report(meter, stages);
     }
-    
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        perror("pipe failed");
-        return -1;
+    if (acct_timing()) {
+        for (int i = 0; i < spawned; i++) {
+            acct_print_stage(stage_of[i] + 1, stages[stage_of[i]][0], &usages[i]);
+        }
     }
-    
-    pid_t left_pid = fork();
-    if (left_pid == 0) {
-        close(pipefd[0]);
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[1]);
-        
-        handle_redirection(left_cmd);
-        
-        execvp(left_cmd[0], left_cmd);
-        perror("Left command failed");
-        exit(1);
+    if (spawned + (inproc >= 0) != stage_count) {
+        last_status = 127;
+    } else if (inproc == stage_count - 1) {
+        last_status = inproc_status;
+    } else {
+        last_status = wait_status(statuses[spawned - 1]);
     }
-    
-    pid_t right_pid = fork();
-    if (right_pid == 0) {
-        close(pipefd[1]);
-        dup2(pipefd[0], STDIN_FILENO);
-        close(pipefd[0]);
-        
-        handle_redirection(right_cmd);
-        
-        execvp(right_cmd[0], right_cmd);
-        perror("Right command failed");
-        exit(1);
+    if (trace_enabled) {
+        char detail[32];
+        snprintf(detail, sizeof(detail), "%d stages", stage_count);
+        trace_span("pipeline", "pipeline", trace_start_ns, detail);
     }
     
-    close(pipefd[0]);
-    close(pipefd[1]);
-    
-    int status;
-    waitpid(left_pid, &status, 0);
-    waitpid(right_pid, &status, 0);
-    
     return 1;
 }
 
+// Start a background command: redirections applied, stream builtins in a
+// child of their own. Returns the pid, or -1.
+pid_t spawn_background(char** arglist) {
+    spawn_actions actions;
+    spawn_actions_init(&actions);
+    pid_t pid = -1;
+    if (redirection_actions(arglist, &actions) == 0) {
+        stream_builtin_fn fn = stream_builtin_find(arglist);
+        pid = fn != NULL ? spawn_stream_builtin(fn, arglist, &actions) : spawn_process(arglist, &actions);
+    }
+    spawn_actions_free(&actions);
+    return pid;
+}
+
 int execute(char* arglist[]) {
     // Expand variables before execution
     expand_variables(arglist);
     
-    if (handle_pipe(arglist) == 1) {
-        return 0;
+    // Pipelines are handled (or rejected) entirely by handle_pipe
+    if (handle_pipe(arglist) != 0) {
+        return last_status;
     }
     
-    int background = handle_background(arglist);
-    
-    int status;
-    int cpid = fork();
-
-    switch (cpid) {
-        case -1:
-            perror("fork failed");
-            exit(1);
-        case 0: // Child process
-            if (handle_redirection(arglist) == -1) {
-                exit(1);
-            }
-            execvp(arglist[0], arglist);
-            perror("Command not found");
-            exit(1);
-        default: // Parent process
-            if (background) {
-                if (job_count < MAX_JOBS) {
-                    background_jobs[job_count] = cpid;
-                    
-                    char cmd_buf[MAX_LEN] = "";
-                    for (int i = 0; arglist[i] != NULL && i < 10; i++) {
-                        if (i > 0) strcat(cmd_buf, " ");
-                        strcat(cmd_buf, arglist[i]);
-                    }
-                    job_commands[job_count] = strdup(cmd_buf);
-                    
-                    printf("[%d] %d\n", job_count + 1, cpid);
-                    job_count++;
-                } else {
-                    printf("Maximum background jobs reached (%d)\n", MAX_JOBS);
-                    waitpid(cpid, &status, 0);
-                }
-            } else {
-                waitpid(cpid, &status, 0);
-            }
-            return 0;
-    }
-}
-
-void add_to_history(const char* cmdline) {
-    if (cmdline == NULL || strlen(cmdline) == 0 || cmdline[0] == '!') {
-        return;
+    // Background jobs start now, or queue behind the jobs -j limit
+    if (handle_background(arglist)) {
+        int id = job_submit(arglist);
+        if (id < 0) {
+            last_status = 127;
+            return last_status;
+        }
+        job* j = job_get(id);
+        if (interactive && j->state == JOB_QUEUED) {
+            printf("[%d] queued\n", id);
+        } else if (interactive) {
+            printf("[%d] %d\n", id, j->pid);
+        }
+        last_status = 0;
+        return last_status;
     }
     
-    if (history_count > 0 && strcmp(history[history_count-1], cmdline) == 0) {
-        return;
+    spawn_actions actions;
+    spawn_actions_init(&actions);
+    if (redirection_actions(arglist, &actions) == -1) {
+        spawn_actions_free(&actions);
+        last_status = 2;
+        return last_status;
     }
     
-    if (history_count < HISTORY_SIZE) {
-        history[history_count] = strdup(cmdline);
-        history_count++;
-    } else {
-        free(history[0]);
-        for (int i = 1; i < HISTORY_SIZE; i++) {
-            history[i-1] = history[i];
-        }
-        history[HISTORY_SIZE-1] = strdup(cmdline);
+    // Stream builtins run in the shell unless they have to be placed
+    stream_builtin_fn fn = stream_builtin_find(arglist);
+    if (fn != NULL && !placement_active()) {
+        last_status = run_stream_builtin(fn, arglist, &actions);
+        spawn_actions_free(&actions);
+        return last_status;
     }
     
-    if (cmdline && *cmdline) {
-        add_history(cmdline);
-    }
-}
-
-void print_history() {
-    printf("Shell command history:\n");
-    for (int i = 0; i < history_count; i++) {
-        printf("%d %s\n", i+1, history[i]);
+    pid_t cpid = fn != NULL ? spawn_stream_builtin(fn, arglist, &actions)
+                            : spawn_process(arglist, &actions);
+    spawn_actions_free(&actions);
+    
+    if (cpid < 0) {
+        last_status = 127;
+        return last_status;
     }
+    last_status = wait_status(wait_for_child(cpid));
+    return last_status;
 }
 
-int execute_from_history(int n) {
-    if (n < 1 || n > history_count) {
-        printf("No such command in history\n");
-        return -1;
+// Builtins run by handle_builtin(); their arguments are expanded here
+// rather than in execute()
+static int is_shell_builtin(const char* name) {
+    static const char* names[] = {"exit", "cd", "help", "jobs", "hash", "history", "export",
+                                  "unset", "set", NULL};
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strcmp(name, names[i]) == 0) return 1;
     }
-    return n-1;
+    return 0;
 }
 
 int handle_builtin(char** arglist) {
@@ -453,30 +287,35 @@ int handle_builtin(char** arglist) {
     }
     
     // Handle variable assignment
+    // ($? is the status of a $(...) in the value, if any)
     if (is_variable_assignment(arglist)) {
+        last_status = 0;
         handle_variables(arglist);
         return 1;
     }
     
+    if (!is_shell_builtin(arglist[0])) {
+        return 0;
+    }
+    expand_variables(arglist);
+    
     if (strcmp(arglist[0], "exit") == 0) {
+        int exit_status = arglist[1] ? atoi(arglist[1]) : last_status;
         if (job_count > 0) {
-            printf("Waiting for background jobs to finish...\n");
-            for (int i = 0; i < job_count; i++) {
-                int status;
-                waitpid(background_jobs[i], &status, 0);
-                free(job_commands[i]);
+            if (interactive) {
+                printf("Waiting for background jobs to finish...\n");
             }
+            wait_for_all_jobs();
         }
         
         // Clean up variables before exit
-        for (int i = 0; i < var_count; i++) {
-            free(var_names[i]);
-            free(var_values[i]);
-        }
+        variables_clear();
         
-        printf("Shell exited.\n");
-        rl_clear_history();
-        exit(0);
+        if (interactive) {
+            printf("Shell exited.\n");
+            rl_clear_history();
+        }
+        exit(exit_status);
         return 1;
     }
     
@@ -486,12 +325,15 @@ int handle_builtin(char** arglist) {
             path = getenv("HOME");
             if (path == NULL) {
                 fprintf(stderr, "cd: HOME environment variable not set\n");
+                last_status = 1;
                 return 1;
             }
         }
         
+        last_status = 0;
         if (chdir(path) != 0) {
             perror("cd failed");
+            last_status = 1;
         }
         return 1;
     }
@@ -499,43 +341,134 @@ int handle_builtin(char** arglist) {
     else if (strcmp(arglist[0], "help") == 0) {
         printf("Built-in commands:\n");
         printf("  cd <directory>    - Change current working directory\n");
-        printf("  exit              - Exit the shell\n");
+        printf("  exit [n]          - Exit the shell\n");
         printf("  help              - Display all shell variables and important environment variables\n");
-        printf("  jobs              - Display background jobs\n");
-        printf("  history           - Display command history\n");
+        printf("  jobs              - Display background jobs: queued, running and done\n");
+        printf("  jobs -j [N]       - Show or set how many background jobs run at once (default: CPUs)\n");
+        printf("  history [n]       - Display command history (last n entries)\n");
+        printf("  history -s PATTERN - Best matches from the whole history, by frequency and recency\n");
+        printf("  hash [-r] [-p path name] - Show, clear or seed the command path cache\n");
         printf("  set               - Display all variables\n");
+        printf("  set -x FILE, set +x - Start/stop tracing into FILE as Chrome trace JSON (or MYSHELL_TRACE=FILE)\n");
+        printf("  export NAME[=value] - Export a variable to the environment\n");
+        printf("  unset NAME        - Remove a variable\n");
+        printf("  cat, tee [-a], cp - Run inside the shell; other options use the system binaries\n");
         printf("\n");
         printf("Variable usage:\n");
         printf("  NAME=value        - Set variable (no spaces around =)\n");
         printf("  NAME=\"value\"     - Set variable with spaces\n");
-        printf("  echo $NAME        - Use variable in commands\n");
+        printf("  echo $NAME        - Use variable in commands; also ${NAME}, $?, $$ and $(command)\n");
         printf("  set               - Display all shell variables and important environment variables\n");
         printf("\n");
         printf("Advanced features:\n");
-        printf("  Tab completion    - Press Tab to complete commands and filenames\n");
+        printf("  Tab completion    - Press Tab to complete commands on PATH, $variables and filenames\n");
         printf("  History navigation - Use Up/Down arrows to browse command history\n");
-        printf("  I/O Redirection   - Use < for input, > for output redirection\n");
-        printf("  Pipes             - Use | to connect commands (e.g., cmd1 | cmd2)\n");
+        printf("  Ctrl-R            - Search the whole history as you type; Ctrl-R again for the next match\n");
+        printf("  I/O Redirection   - < in, > out, >> append, 2> err, 2>&1, N>&M, N>&- (close)\n");
+        printf("  Here-documents    - cmd <<EOF (lines up to EOF) and cmd <<< word feed stdin from memory\n");
+        printf("                      $VAR and $(...) in the body expand unless EOF is quoted: <<'EOF'\n");
+        printf("  Pipes             - Use | to connect commands (e.g., cmd1 | cmd2 | cmd3)\n");
         printf("  Command chaining  - Use ; to run multiple commands sequentially\n");
         printf("  Background jobs   - Use & to run commands in background\n");
-        printf("  If-then-else     - Use if-then-else-fi for conditional execution\n");
+        printf("  TMOUT=N           - Log out after N idle seconds at the prompt\n");
+        printf("  Fast builtins     - cat, tee, cp, echo, printf, test/[, true, false and : run without a new process\n");
+        printf("  time CMDLINE      - Report real/user/sys time, max RSS, context switches and block I/O\n");
+        printf("  MYSHELL_TIMELOG=f - Append the same numbers for every command line to file f\n");
+        printf("  pipesize SIZE CMD - Run CMD's pipelines with SIZE-byte pipes (K/M suffix; or MYSHELL_PIPESIZE)\n");
+        printf("  pin CPUS CMD      - Run CMD's processes on CPUS (0-3,8 or node:N)\n");
+        printf("  nice [-n N] CMD   - Run CMD's processes N (default 10) nice levels lower\n");
+        printf("  cg PATH CMD       - Run CMD's processes in cgroup PATH (under /sys/fs/cgroup)\n");
+        printf("  meter CMD         - Report bytes, MB/s and stall time per pipeline stage (or MYSHELL_PIPEMETER=1)\n");
+        printf("  parallel [-j N]   - Run the following lines (up to 'end'), or a ; chain, N at a time\n");
+        printf("  if/elif/else/fi   - Run a branch by the exit status of its condition\n");
+        printf("  while COND; do    - Repeat the body up to 'done' while COND succeeds\n");
+        printf("  for V in WORDS; do - Run the body up to 'done' once per word, with $V set\n");
+        printf("  break, continue   - Leave the innermost loop, or start its next iteration\n");
+        printf("  Scripts           - myshell script.sh, myshell -c 'cmd' or piped input\n");
+        last_status = 0;
         return 1;
     }
     
     else if (strcmp(arglist[0], "jobs") == 0) {
+        // jobs -j [N]: show or set how many background jobs run at once
+        if (arglist[1] != NULL && strcmp(arglist[1], "-j") == 0) {
+            last_status = 0;
+            if (arglist[2] == NULL) {
+                printf("%d\n", jobs_limit());
+            } else if (atoi(arglist[2]) > 0) {
+                jobs_set_limit(atoi(arglist[2]));
+            } else {
+                fprintf(stderr, "jobs: %s: invalid job limit\n", arglist[2]);
+                last_status = 2;
+            }
+            return 1;
+        }
         print_jobs();
+        last_status = 0;
+        return 1;
+    }
+    
+    else if (strcmp(arglist[0], "hash") == 0) {
+        last_status = handle_hash(arglist);
         return 1;
     }
     
     else if (strcmp(arglist[0], "history") == 0) {
-        print_history();
+        if (arglist[1] != NULL && strcmp(arglist[1], "-s") == 0) {
+            if (arglist[2] == NULL) {
+                fprintf(stderr, "history: usage: history -s pattern\n");
+                last_status = 2;
+                return 1;
+            }
+            // The rest of the line is the pattern, spaces included
+            char pattern[MAX_LEN] = "";
+            for (int i = 2; arglist[i] != NULL; i++) {
+                if (i > 2) strncat(pattern, " ", sizeof(pattern) - strlen(pattern) - 1);
+                strncat(pattern, arglist[i], sizeof(pattern) - strlen(pattern) - 1);
+            }
+            last_status = print_history_search(pattern);
+            return 1;
+        }
+        if (arglist[1] != NULL && atoi(arglist[1]) <= 0) {
+            fprintf(stderr, "history: %s: numeric argument required\n", arglist[1]);
+            last_status = 1;
+            return 1;
+        }
+        print_history(arglist[1] ? atoi(arglist[1]) : 0);
+        last_status = 0;
+        return 1;
+    }
+    
+    else if (strcmp(arglist[0], "export") == 0) {
+        last_status = handle_export(arglist);
+        return 1;
+    }
+    
+    else if (strcmp(arglist[0], "unset") == 0) {
+        last_status = handle_unset(arglist);
         return 1;
     }
     
     // set command to display variables
     else if (strcmp(arglist[0], "set") == 0) {
+        // set -x FILE / set +x: execution tracing
+        if (arglist[1] != NULL && strcmp(arglist[1], "-x") == 0) {
+            const char* path = arglist[2] != NULL ? arglist[2] : var_get("MYSHELL_TRACE");
+            if (path == NULL || *path == '\0') {
+                fprintf(stderr, "set: usage: set -x FILE\n");
+                last_status = 2;
+            } else {
+                last_status = trace_start(path) == 0 ? 0 : 1;
+            }
+            return 1;
+        }
+        if (arglist[1] != NULL && strcmp(arglist[1], "+x") == 0) {
+            trace_stop();
+            last_status = 0;
+            return 1;
+        }
         print_variables();
-        // debug_print_variables(); // Uncomment for debugging
+        last_status = 0;
         return 1;
     }
     
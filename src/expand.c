@@ -0,0 +1,294 @@
+#include "shell.h"
+#include <errno.h>
+#include <sys/mman.h>
+
+// Word expansion: $NAME, ${NAME}, $0-$9, $?, $$ and $(command) anywhere in
+// a word.
+//
+// Each word is expanded in one left-to-right pass into a single buffer
+// (on the stack for short words) and copied once into command_arena.
+// Words without a '$' are left as they are. Variables are read from the
+// shell's variable table, which already holds the environment.
+//
+// $(command) runs command with its stdout captured and trailing newlines
+// removed. A command that is a single stream builtin (echo, printf, cat...)
+// runs in the shell, writing into a memfd; anything else runs in a forked
+// copy of the shell writing into a pipe. Nothing is written to disk either
+// way. The result is not split into fields: it stays one word, as if the
+// substitution had been quoted.
+
+#define EXPAND_LOCAL_SIZE 256
+
+// Runs the command of a $(...) in the forked child; main() points this at
+// its line dispatcher. Without it only simple commands are supported.
+int (*substitution_runner)(char*) = NULL;
+
+// $$: the pid of the shell itself, also in subshells
+pid_t shell_pid = 0;
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+    int heap;
+} word_buffer;
+
+static void word_reserve(word_buffer* w, size_t extra) {
+    if (w->len + extra <= w->capacity) {
+        return;
+    }
+    size_t capacity = w->capacity * 2;
+    while (capacity < w->len + extra) capacity *= 2;
+    char* data = w->heap ? realloc(w->data, capacity) : malloc(capacity);
+    if (data == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    if (!w->heap) {
+        memcpy(data, w->data, w->len);
+    }
+    w->data = data;
+    w->capacity = capacity;
+    w->heap = 1;
+}
+
+static void word_append(word_buffer* w, const char* s, size_t len) {
+    word_reserve(w, len);
+    memcpy(w->data + w->len, s, len);
+    w->len += len;
+}
+
+// Length of the $(...) starting at s, or 0 if it is not closed. Nested
+// parentheses and double-quoted text are skipped over.
+size_t substitution_length(const char* s) {
+    if (s[0] != '$' || s[1] != '(') {
+        return 0;
+    }
+    int depth = 0;
+    int in_quotes = 0;
+    for (const char* p = s + 1; *p; p++) {
+        if (*p == '"') {
+            in_quotes = !in_quotes;
+        } else if (!in_quotes && *p == '(') {
+            depth++;
+        } else if (!in_quotes && *p == ')' && --depth == 0) {
+            return p + 1 - s;
+        }
+    }
+    return 0;
+}
+
+static int is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Append everything fd delivers until end of file
+static void word_read_all(word_buffer* w, int fd) {
+    while (1) {
+        word_reserve(w, 4096);
+        ssize_t n = read(fd, w->data + w->len, w->capacity - w->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        w->len += n;
+    }
+}
+
+static int run_simple_line(char* line) {
+    char** arglist = tokenize(line);
+    if (arglist != NULL && !handle_builtin(arglist)) {
+        execute(arglist);
+    }
+    return last_status;
+}
+
+// A lone stream builtin, run in the shell with stdout in a memfd.
+// Returns 0 if command is not one. The name is checked before anything is
+// expanded, so a command that is not a builtin is left for the forked path
+// with its nested substitutions still unrun.
+static int substitute_builtin(word_buffer* w, char* command) {
+    char** arglist = tokenize(command);
+    if (arglist == NULL) {
+        return 0;
+    }
+    for (int i = 0; arglist[i] != NULL; i++) {
+        if (strcmp(arglist[i], "|") == 0 || strcmp(arglist[i], "&") == 0 || strcmp(arglist[i], ";") == 0) {
+            return 0;
+        }
+    }
+    char* name[] = {arglist[0], NULL};
+    if (strchr(arglist[0], '$') != NULL || stream_builtin_find(name) == NULL) {
+        return 0;
+    }
+
+    int fd = memfd_create("substitution", MFD_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    expand_variables(arglist);
+    spawn_actions actions;
+    spawn_actions_init(&actions);
+    spawn_add_fd(&actions, fd, STDOUT_FILENO);
+    if (redirection_actions(arglist, &actions) != 0) {
+        last_status = 2;
+    } else {
+        // The expanded options may be ones the builtin leaves to the real
+        // program; run that on the words already expanded
+        stream_builtin_fn fn = stream_builtin_find(arglist);
+        if (fn != NULL) {
+            last_status = run_stream_builtin(fn, arglist, &actions);
+        } else {
+            fflush(stdout);
+            pid_t pid = spawn_process(arglist, &actions);
+            last_status = pid > 0 ? wait_status(wait_for_child(pid)) : 127;
+        }
+    }
+    lseek(fd, 0, SEEK_SET);
+    word_read_all(w, fd);
+    spawn_actions_free(&actions);
+    return 1;
+}
+
+// Append the output of command, run in a forked shell, read over a pipe
+static void substitute_forked(word_buffer* w, char* command) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe failed");
+        last_status = 1;
+        return;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        interactive = 0;
+        int status = substitution_runner != NULL ? substitution_runner(command) : run_simple_line(command);
+        fflush(stdout);
+        _exit(status);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        perror("fork failed");
+        close(fds[0]);
+        last_status = 1;
+        return;
+    }
+    word_read_all(w, fds[0]);
+    close(fds[0]);
+    last_status = wait_status(wait_for_child(pid));
+}
+
+static void substitute(word_buffer* w, const char* command, size_t len) {
+    size_t start = w->len;
+    arena_mark mark = arena_save(&command_arena);
+    char* copy = arena_strndup(&command_arena, command, len);
+    if (!substitute_builtin(w, copy)) {
+        arena_restore(&command_arena, mark);
+        copy = arena_strndup(&command_arena, command, len);
+        substitute_forked(w, copy);
+    }
+    arena_restore(&command_arena, mark);
+
+    while (w->len > start && w->data[w->len - 1] == '\n') {
+        w->len--;
+    }
+}
+
+// Expand one word. Returns word itself when there is nothing to expand,
+// otherwise a copy in command_arena.
+char* expand_word(char* word) {
+    char* dollar = strchr(word, '$');
+    if (dollar == NULL) {
+        return word;
+    }
+
+    // The common case: the whole word is one $NAME
+    if (dollar == word && is_name_start(word[1])) {
+        const char* end = word + 2;
+        while (is_name_char(*end)) end++;
+        if (*end == '\0') {
+            const char* value = var_lookup(word + 1, end - word - 1);
+            return arena_strdup(&command_arena, value != NULL ? value : "");
+        }
+    }
+
+    char local[EXPAND_LOCAL_SIZE];
+    word_buffer w = {local, 0, sizeof(local), 0};
+    const char* p = word;
+    while (dollar != NULL) {
+        word_append(&w, p, dollar - p);
+        p = dollar + 1;
+
+        if (*p == '?') {
+            char status[16];
+            word_append(&w, status, snprintf(status, sizeof(status), "%d", last_status));
+            p++;
+        } else if (*p == '$') {
+            char pid[16];
+            word_append(&w, pid, snprintf(pid, sizeof(pid), "%d", (int)(shell_pid ? shell_pid : getpid())));
+            p++;
+        } else if (*p == '(' && substitution_length(dollar) > 0) {
+            size_t len = substitution_length(dollar);
+            substitute(&w, p + 1, len - 3);
+            p = dollar + len;
+        } else if (*p == '{' && is_name_char(p[1])) {
+            const char* name = p + 1;
+            const char* end = name;
+            if (isdigit((unsigned char)*name)) {
+                while (isdigit((unsigned char)*end)) end++;
+            } else {
+                while (is_name_char(*end)) end++;
+            }
+            if (*end == '}') {
+                const char* value = var_lookup(name, end - name);
+                if (value != NULL) word_append(&w, value, strlen(value));
+                p = end + 1;
+            } else {
+                word_append(&w, "$", 1);
+            }
+        } else if (isdigit((unsigned char)*p)) {
+            // Positional parameters: $0 to $9, ${10} and up
+            const char* value = var_lookup(p, 1);
+            if (value != NULL) word_append(&w, value, strlen(value));
+            p++;
+        } else if (is_name_start(*p)) {
+            const char* end = p;
+            while (is_name_char(*end)) end++;
+            const char* value = var_lookup(p, end - p);
+            if (value != NULL) word_append(&w, value, strlen(value));
+            p = end;
+        } else {
+            word_append(&w, "$", 1);
+        }
+        dollar = strchr(p, '$');
+    }
+    word_append(&w, p, strlen(p));
+
+    char* expanded = arena_strndup(&command_arena, w.data, w.len);
+    if (w.heap) {
+        free(w.data);
+    }
+    return expanded;
+}
+
+// Expand every argument in place, here-document bodies included unless
+// their delimiter was quoted.
+void expand_variables(char** arglist) {
+    uint64_t start = trace_enabled ? trace_now() : 0;
+    for (int i = 0; arglist[i] != NULL; i++) {
+        // The body of a here-document with a quoted delimiter stays as written
+        if (i > 0 && redirection_kind(arglist[i - 1]) == REDIR_HEREDOC_LITERAL) {
+            continue;
+        }
+        arglist[i] = expand_word(arglist[i]);
+    }
+    if (trace_enabled) {
+        trace_span("expand", "expand", start, arglist[0]);
+    }
+}
@@ -0,0 +1,263 @@
+#include "shell.h"
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+// Persistent command history.
+//
+// Commands are appended to a text file ($HISTFILE, default
+// ~/.myshell_history), one per line, and the byte offset of every line is
+// appended to a companion index file (<file>.idx) of 64-bit offsets. Both
+// appends happen under an exclusive flock on the text file, so any number of
+// shells can share the files. Startup reads only the tail of the index -
+// never the text file - and entries are read through a shared mmap of the
+// text file when they are needed.
+//
+// In memory, history is a ring of the last HISTORY_SIZE offsets, so adding a
+// command is O(1) once the ring is full and !n is a single array lookup.
+
+#define HISTORY_INDEX_SUFFIX ".idx"
+#define HISTORY_READLINE_SEED 1000
+
+int history_count = 0;
+
+static int history_ready = 0;
+static int history_fd = -1;
+static int history_index_fd = -1;
+static char* history_map = NULL;
+static size_t history_map_size = 0;
+static uint64_t* history_ring = NULL;
+static int history_head = 0;   // ring position of the oldest entry
+
+// Open (or create) the history files. Falls back to anonymous memory files
+// if there is no usable home directory, so history still works in-session.
+static void history_open_files() {
+    char path[MAX_LEN];
+    const char* histfile = getenv("HISTFILE");
+    const char* home = getenv("HOME");
+
+    if (histfile != NULL && *histfile) {
+        snprintf(path, sizeof(path), "%s", histfile);
+    } else if (home != NULL) {
+        snprintf(path, sizeof(path), "%s/.myshell_history", home);
+    } else {
+        path[0] = '\0';
+    }
+
+    if (path[0] != '\0') {
+        history_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        strncat(path, HISTORY_INDEX_SUFFIX, sizeof(path) - strlen(path) - 1);
+        history_index_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    }
+
+    if (history_fd == -1 || history_index_fd == -1) {
+        if (history_fd != -1) close(history_fd);
+        if (history_index_fd != -1) close(history_index_fd);
+        history_fd = memfd_create("myshell_history", MFD_CLOEXEC);
+        history_index_fd = memfd_create("myshell_history_index", MFD_CLOEXEC);
+    }
+}
+
+// Make sure the mapping covers at least `size` bytes of the text file
+static int history_map_covers(size_t size) {
+    if (size <= history_map_size) {
+        return 1;
+    }
+    struct stat st;
+    if (fstat(history_fd, &st) == -1 || (size_t)st.st_size < size) {
+        return 0;
+    }
+    if (history_map != NULL) {
+        munmap(history_map, history_map_size);
+    }
+    history_map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, history_fd, 0);
+    if (history_map == MAP_FAILED) {
+        history_map = NULL;
+        history_map_size = 0;
+        return 0;
+    }
+    history_map_size = st.st_size;
+    return 1;
+}
+
+// Text of the entry at offset: not NUL-terminated, valid until the mapping
+// next grows
+const char* history_store_text(uint64_t offset, size_t* len) {
+    if (!history_map_covers(offset + 1)) {
+        return NULL;
+    }
+    const char* start = history_map + offset;
+    const char* newline = memchr(start, '\n', history_map_size - offset);
+    if (newline == NULL) {
+        return NULL;
+    }
+    *len = newline - start;
+    return start;
+}
+
+// Text of the entry at ring position i (0 = oldest)
+static const char* history_text(int i, size_t* len) {
+    return history_store_text(history_ring[(history_head + i) % HISTORY_SIZE], len);
+}
+
+static void history_init() {
+    if (history_ready) {
+        return;
+    }
+    history_ready = 1;
+
+    history_open_files();
+    history_ring = malloc(sizeof(uint64_t) * HISTORY_SIZE);
+
+    // Load the offsets of the most recent entries from the index tail
+    flock(history_fd, LOCK_SH);
+    struct stat st;
+    if (fstat(history_index_fd, &st) == 0) {
+        long entries = st.st_size / sizeof(uint64_t);
+        long n = entries < HISTORY_SIZE ? entries : HISTORY_SIZE;
+        ssize_t bytes = pread(history_index_fd, history_ring, n * sizeof(uint64_t),
+                              (entries - n) * sizeof(uint64_t));
+        history_count = bytes > 0 ? bytes / sizeof(uint64_t) : 0;
+    }
+    flock(history_fd, LOCK_UN);
+
+    // Give readline's arrow-key history the most recent entries
+    if (interactive) {
+        int first = history_count > HISTORY_READLINE_SEED ? history_count - HISTORY_READLINE_SEED : 0;
+        for (int i = first; i < history_count; i++) {
+            size_t len;
+            const char* text = history_text(i, &len);
+            if (text != NULL) {
+                char* line = strndup(text, len);
+                add_history(line);
+                free(line);
+            }
+        }
+    }
+}
+
+void add_to_history(const char* cmdline) {
+    if (cmdline == NULL || strlen(cmdline) == 0 || cmdline[0] == '!') {
+        return;
+    }
+
+    history_init();
+
+    size_t len = strlen(cmdline);
+    if (history_count > 0) {
+        size_t last_len;
+        const char* last = history_text(history_count - 1, &last_len);
+        if (last != NULL && last_len == len && memcmp(last, cmdline, len) == 0) {
+            return;
+        }
+    }
+
+    // Append the line and its offset while holding the lock, so entries
+    // from concurrent shells never interleave
+    flock(history_fd, LOCK_EX);
+    struct stat st;
+    uint64_t offset = 0;
+    if (fstat(history_fd, &st) == 0) {
+        offset = st.st_size;
+    }
+    struct iovec iov[2] = {
+        {(void*)cmdline, len},
+        {"\n", 1},
+    };
+    int written = writev(history_fd, iov, 2) == (ssize_t)(len + 1);
+
+    // Drop a partial offset left behind by an interrupted writer
+    if (written && fstat(history_index_fd, &st) == 0) {
+        if (st.st_size % sizeof(uint64_t) != 0) {
+            if (ftruncate(history_index_fd, st.st_size - st.st_size % sizeof(uint64_t)) == -1) {
+                written = 0;
+            }
+        }
+        if (written && write(history_index_fd, &offset, sizeof(offset)) != sizeof(offset)) {
+            written = 0;
+        }
+    }
+    flock(history_fd, LOCK_UN);
+
+    if (!written) {
+        return;
+    }
+
+    if (history_count < HISTORY_SIZE) {
+        history_ring[(history_head + history_count) % HISTORY_SIZE] = offset;
+        history_count++;
+    } else {
+        history_ring[history_head] = offset;
+        history_head = (history_head + 1) % HISTORY_SIZE;
+    }
+
+    add_history(cmdline);
+}
+
+// Print the whole history, or only the last `last` entries
+void print_history(int last) {
+    history_init();
+
+    int first = 0;
+    if (last > 0 && last < history_count) {
+        first = history_count - last;
+    }
+
+    printf("Shell command history:\n");
+    for (int i = first; i < history_count; i++) {
+        size_t len;
+        const char* text = history_text(i, &len);
+        if (text != NULL) {
+            printf("%d %.*s\n", i + 1, (int)len, text);
+        }
+    }
+}
+
+// Return a copy of history entry n (1 = oldest), or NULL
+char* history_entry(int n) {
+    history_init();
+
+    if (n < 1 || n > history_count) {
+        printf("No such command in history\n");
+        return NULL;
+    }
+    size_t len;
+    const char* text = history_text(n - 1, &len);
+    return text ? strndup(text, len) : NULL;
+}
+
+// The whole store, for search: every entry ever recorded, by any shell
+
+// Number of entries in the store
+long history_store_size() {
+    history_init();
+    struct stat st;
+    if (fstat(history_index_fd, &st) == -1) {
+        return 0;
+    }
+    return st.st_size / sizeof(uint64_t);
+}
+
+// Read the offsets of up to max entries from entry first on. Returns how
+// many were read.
+long history_store_offsets(long first, uint64_t* offsets, long max) {
+    history_init();
+    ssize_t bytes = pread(history_index_fd, offsets, max * sizeof(uint64_t), first * sizeof(uint64_t));
+    return bytes > 0 ? bytes / (long)sizeof(uint64_t) : 0;
+}
+
+// The !n number of the entry at offset, or 0 if it is no longer in the ring.
+// Offsets grow along the ring, so this is a binary search.
+int history_number(uint64_t offset) {
+    int low = 0;
+    int high = history_count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        uint64_t at = history_ring[(history_head + mid) % HISTORY_SIZE];
+        if (at == offset) return mid + 1;
+        if (at < offset) low = mid + 1;
+        else high = mid - 1;
+    }
+    return 0;
+}
@@ -0,0 +1,423 @@
+#include "shell.h"
+
+// Search over the whole history store: history -s PATTERN and Ctrl-R.
+//
+// Every distinct command line gets an id, with its use count and the
+// position of its latest use. A trigram index maps each three-byte
+// sequence to the sorted ids of the commands containing it. A pattern of
+// three or more bytes is looked up by intersecting the lists of its
+// trigrams, shortest first, and checking the survivors with memmem().
+// Shorter patterns, and those whose every trigram is common, match too much
+// for that to help; they walk the store from the newest entry back until
+// nothing older can rank high enough.
+//
+// Matches are ranked by frecency: bits(uses) / bits(entries since the last
+// use), with bits(n) the bit length of n, so using a command twice as often
+// counts as much as having used it twice as recently. Ties go to the most
+// recent.
+//
+// The index is built on the first search, and each search first indexes
+// whatever was added to the store since, by this shell or any other.
+
+#define TRIGRAM_USED (1u << 24)
+#define SYNC_CHUNK 65536
+#define SEARCH_RESULTS 64
+#define SEARCH_COMMON 64   // a trigram in 1/64 of all commands is common
+
+typedef struct {
+    uint64_t offset;   // latest use
+    long last;         // store position of the latest use
+    uint32_t hash;
+    uint32_t len;
+    int count;
+} search_command;
+
+typedef struct {
+    uint32_t key;
+    int count;
+    int capacity;
+    int* ids;
+} trigram_list;
+
+static search_command* commands = NULL;
+static int command_count = 0;
+static int command_capacity = 0;
+static int* command_slots = NULL;   // id + 1, by hash
+static int command_slot_count = 0;
+
+static trigram_list* trigrams = NULL;
+static int trigram_slot_count = 0;
+static int trigram_count = 0;
+
+static long indexed = 0;   // store entries indexed so far
+static int* entry_ids = NULL;   // command id of each store entry, or -1
+static int entry_capacity = 0;
+static int max_count = 0;
+
+static void* grow(void* data, int* capacity, size_t size, int initial) {
+    *capacity = *capacity ? *capacity * 2 : initial;
+    data = realloc(data, size * *capacity);
+    if (data == NULL) {
+        perror("realloc failed");
+        exit(1);
+    }
+    return data;
+}
+
+static trigram_list* trigram_slot(uint32_t key) {
+    uint32_t mask = trigram_slot_count - 1;
+    uint32_t i = (key * 2654435761u) & mask;
+    while (trigrams[i].key != 0 && trigrams[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    return &trigrams[i];
+}
+
+static void trigrams_grow() {
+    trigram_list* old = trigrams;
+    int old_count = trigram_slot_count;
+    trigram_slot_count = old_count ? old_count * 2 : 4096;
+    trigrams = calloc(trigram_slot_count, sizeof(trigram_list));
+    for (int i = 0; i < old_count; i++) {
+        if (old[i].key != 0) {
+            *trigram_slot(old[i].key) = old[i];
+        }
+    }
+    free(old);
+}
+
+static uint32_t trigram_key(const char* s) {
+    return TRIGRAM_USED | (unsigned char)s[0] << 16 | (unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+// Ids are added in increasing order, so a repeated trigram in one command
+// is the list's last entry
+static void trigram_add(uint32_t key, int id) {
+    if ((trigram_count + 1) * 4 > trigram_slot_count * 3) {
+        trigrams_grow();
+    }
+    trigram_list* list = trigram_slot(key);
+    if (list->key == 0) {
+        list->key = key;
+        trigram_count++;
+    } else if (list->ids[list->count - 1] == id) {
+        return;
+    }
+    if (list->count == list->capacity) {
+        list->ids = grow(list->ids, &list->capacity, sizeof(int), 4);
+    }
+    list->ids[list->count++] = id;
+}
+
+static int* command_slot(const char* text, size_t len, uint32_t hash) {
+    uint32_t mask = command_slot_count - 1;
+    uint32_t i = hash & mask;
+    while (command_slots[i] != 0) {
+        search_command* c = &commands[command_slots[i] - 1];
+        size_t c_len;
+        const char* c_text;
+        if (c->hash == hash && c->len == len && (c_text = history_store_text(c->offset, &c_len)) != NULL &&
+            memcmp(c_text, text, len) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &command_slots[i];
+}
+
+static void command_slots_grow() {
+    free(command_slots);
+    command_slot_count = command_slot_count ? command_slot_count * 2 : 4096;
+    command_slots = calloc(command_slot_count, sizeof(int));
+    for (int id = 0; id < command_count; id++) {
+        uint32_t i = commands[id].hash & (command_slot_count - 1);
+        while (command_slots[i] != 0) i = (i + 1) & (command_slot_count - 1);
+        command_slots[i] = id + 1;
+    }
+}
+
+// Index the store entry at position, whose text is at offset
+static void index_entry(long position, uint64_t offset) {
+    if (position >= entry_capacity) {
+        entry_ids = grow(entry_ids, &entry_capacity, sizeof(int), 65536);
+    }
+    entry_ids[position] = -1;
+    size_t len;
+    const char* text = history_store_text(offset, &len);
+    if (text == NULL) {
+        return;
+    }
+    if ((command_count + 1) * 2 > command_slot_count) {
+        command_slots_grow();
+    }
+    uint32_t hash = hash_bytes(text, len);
+    int* slot = command_slot(text, len, hash);
+    if (*slot != 0) {
+        search_command* c = &commands[*slot - 1];
+        c->offset = offset;
+        c->last = position;
+        c->count++;
+        if (c->count > max_count) max_count = c->count;
+        entry_ids[position] = *slot - 1;
+        return;
+    }
+
+    if (command_count == command_capacity) {
+        commands = grow(commands, &command_capacity, sizeof(search_command), 1024);
+    }
+    int id = command_count++;
+    commands[id] = (search_command){offset, position, hash, len, 1};
+    *slot = id + 1;
+    entry_ids[position] = id;
+    if (max_count == 0) max_count = 1;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        trigram_add(trigram_key(text + i), id);
+    }
+}
+
+// Catch up with entries added to the store since the last search
+static void search_sync() {
+    long size = history_store_size();
+    uint64_t* offsets = NULL;
+    while (indexed < size) {
+        if (offsets == NULL) offsets = malloc(sizeof(uint64_t) * SYNC_CHUNK);
+        long n = history_store_offsets(indexed, offsets, size - indexed < SYNC_CHUNK ? size - indexed : SYNC_CHUNK);
+        if (n == 0) break;
+        for (long i = 0; i < n; i++) {
+            index_entry(indexed + i, offsets[i]);
+        }
+        indexed += n;
+    }
+    free(offsets);
+}
+
+static int bit_length(unsigned long n) {
+    return n == 0 ? 0 : 64 - __builtin_clzl(n);
+}
+
+// Whether command a ranks above command b
+static int ranks_above(const search_command* a, const search_command* b) {
+    long lhs = (long)bit_length(a->count) * bit_length(indexed - b->last + 1);
+    long rhs = (long)bit_length(b->count) * bit_length(indexed - a->last + 1);
+    return lhs != rhs ? lhs > rhs : a->last > b->last;
+}
+
+// Keep ids[0..*found) as the best max commands, best first
+static void rank_insert(int* ids, int* found, int max, int id) {
+    if (*found == max && !ranks_above(&commands[id], &commands[ids[max - 1]])) {
+        return;
+    }
+    int i = *found < max ? (*found)++ : max - 1;
+    while (i > 0 && ranks_above(&commands[id], &commands[ids[i - 1]])) {
+        ids[i] = ids[i - 1];
+        i--;
+    }
+    ids[i] = id;
+}
+
+static int command_contains(int id, const char* pattern, size_t len) {
+    size_t text_len;
+    const char* text = history_store_text(commands[id].offset, &text_len);
+    return text != NULL && memmem(text, text_len, pattern, len) != NULL;
+}
+
+// Last index in list at or before to holding a value <= id, or -1.
+// Successive calls move down the list in small steps, so this gallops back
+// from to before bisecting.
+static int floor_index(const trigram_list* list, int to, int id) {
+    int step = 1;
+    int high = to;
+    while (high >= 0 && list->ids[high] > id) {
+        to = high;
+        high -= step;
+        step *= 2;
+    }
+    if (high >= 0 && high == to) {
+        return high;
+    }
+    // ids[high] <= id < ids[to]
+    int low = high < 0 ? 0 : high + 1;
+    while (low < to) {
+        int mid = (low + to) / 2;
+        if (list->ids[mid] <= id) low = mid + 1;
+        else to = mid;
+    }
+    return low - 1;
+}
+
+// Short or common patterns: walk the store newest first, stopping once even the most
+// used command could not outrank the worst match found at that age
+static void search_recent(const char* pattern, size_t len, int* ids, int* found, int max) {
+    int best_bits = bit_length(max_count);
+    for (long position = indexed - 1; position >= 0; position--) {
+        int id = entry_ids[position];
+        if (id < 0 || commands[id].last != position) {
+            continue;
+        }
+        if (*found == max) {
+            const search_command* worst = &commands[ids[max - 1]];
+            if ((long)best_bits * bit_length(indexed - worst->last + 1) <=
+                (long)bit_length(worst->count) * bit_length(indexed - position + 1)) {
+                break;
+            }
+        }
+        if (command_contains(id, pattern, len)) {
+            rank_insert(ids, found, max, id);
+        }
+    }
+}
+
+// Longer patterns: intersect the pattern's trigram lists. Newer ids go
+// first, as they tend to rank higher and fill the results early. Returns 0,
+// having done nothing, if even the shortest list is so long that walking
+// the store will fill the results sooner.
+static int search_trigrams(const char* pattern, size_t len, int* ids, int* found, int max) {
+    // The pattern's distinct trigram lists, shortest first
+    trigram_list* lists[MAX_LEN];
+    int cursors[MAX_LEN];
+    int count = 0;
+    for (size_t i = 0; i + 3 <= len && count < MAX_LEN; i++) {
+        trigram_list* list = trigram_slot_count ? trigram_slot(trigram_key(pattern + i)) : NULL;
+        if (list == NULL || list->key == 0) {
+            return 1;
+        }
+        int j = 0;
+        while (j < count && lists[j] != list) j++;
+        if (j < count) {
+            continue;
+        }
+        while (j > 0 && lists[j - 1]->count > list->count) {
+            lists[j] = lists[j - 1];
+            j--;
+        }
+        lists[j] = list;
+        count++;
+    }
+    if (count == 0 || (long)lists[0]->count * SEARCH_COMMON > command_count) {
+        return 0;
+    }
+    for (int l = 0; l < count; l++) {
+        cursors[l] = lists[l]->count - 1;
+    }
+
+    for (int k = lists[0]->count - 1; k >= 0; k--) {
+        int id = lists[0]->ids[k];
+        int present = 1;
+        for (int l = 1; l < count && present; l++) {
+            cursors[l] = floor_index(lists[l], cursors[l], id);
+            present = cursors[l] >= 0 && lists[l]->ids[cursors[l]] == id;
+        }
+        // A single trigram is an exact match already
+        if (present && (len == 3 || command_contains(id, pattern, len))) {
+            rank_insert(ids, found, max, id);
+        }
+    }
+    return 1;
+}
+
+// The best max commands containing pattern, best first. Returns how many.
+int history_find(const char* pattern, history_match* matches, int max) {
+    size_t len = strlen(pattern);
+    int ids[SEARCH_RESULTS];
+    int found = 0;
+    if (max > SEARCH_RESULTS) max = SEARCH_RESULTS;
+    if (max <= 0) return 0;
+
+    search_sync();
+    if (len < 3 || !search_trigrams(pattern, len, ids, &found, max)) {
+        search_recent(pattern, len, ids, &found, max);
+    }
+
+    for (int i = 0; i < found; i++) {
+        matches[i].offset = commands[ids[i]].offset;
+        matches[i].count = commands[ids[i]].count;
+    }
+    return found;
+}
+
+// history -s PATTERN: the best matches, best last so it is nearest the
+// prompt, numbered for !n where they still can be
+int print_history_search(const char* pattern) {
+    history_match matches[SEARCH_RESULTS];
+    int found = history_find(pattern, matches, 20);
+    for (int i = found - 1; i >= 0; i--) {
+        size_t len;
+        const char* text = history_store_text(matches[i].offset, &len);
+        int number = history_number(matches[i].offset);
+        if (text == NULL) continue;
+        if (number > 0) {
+            printf("%d %.*s\n", number, (int)len, text);
+        } else {
+            printf("- %.*s\n", (int)len, text);
+        }
+    }
+    return found > 0 ? 0 : 1;
+}
+
+// Show the current match (or the line being searched from) under a
+// search prompt
+static void search_show(const char* query, history_match* matches, int found, int shown, const char* original) {
+    size_t len = strlen(original);
+    const char* text = original;
+    if (found > 0) {
+        text = history_store_text(matches[shown].offset, &len);
+    }
+    char* line = strndup(text != NULL ? text : "", len);
+    rl_replace_line(line, 0);
+    char* at = query[0] != '\0' ? strstr(line, query) : NULL;
+    rl_point = at != NULL ? at - line : 0;
+    free(line);
+    rl_message("(%s-search)`%s': ", found > 0 || query[0] == '\0' ? "history" : "failing history", query);
+    rl_redisplay();
+}
+
+// Ctrl-R: incremental search of the whole history, best match first. Typing
+// narrows the search, Backspace widens it, Ctrl-R steps to the next match,
+// Enter runs the match, Ctrl-G restores the line; any other key keeps the
+// match and is then handled as usual.
+int history_search_key(int count, int key) {
+    (void)count;
+    (void)key;
+    char query[MAX_LEN] = "";
+    size_t query_len = 0;
+    history_match matches[SEARCH_RESULTS];
+    int found = 0;
+    int shown = 0;
+    char* original = strdup(rl_line_buffer);
+    int original_point = rl_point;
+
+    rl_save_prompt();
+    search_show(query, matches, found, shown, original);
+    while (1) {
+        int c = event_read_key();
+        if (c == '\x12') {
+            if (shown + 1 < found) shown++;
+        } else if ((c == 127 || c == '\b') && query_len > 0) {
+            query[--query_len] = '\0';
+            found = query_len ? history_find(query, matches, SEARCH_RESULTS) : 0;
+            shown = 0;
+        } else if (isprint(c) && query_len + 1 < sizeof(query)) {
+            query[query_len++] = c;
+            query[query_len] = '\0';
+            found = history_find(query, matches, SEARCH_RESULTS);
+            shown = 0;
+        } else {
+            rl_restore_prompt();
+            rl_clear_message();
+            if (c == '\a' || c < 0) {
+                rl_replace_line(original, 0);
+                rl_point = original_point;
+            } else if (c == '\r' || c == '\n') {
+                free(original);
+                return rl_newline(1, c);
+            } else if (c != 127 && c != '\b') {
+                rl_execute_next(c);
+            }
+            rl_redisplay();
+            break;
+        }
+        search_show(query, matches, found, shown, original);
+    }
+    free(original);
+    return 0;
+}
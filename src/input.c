@@ -0,0 +1,90 @@
+#include "shell.h"
+#include <errno.h>
+
+// Buffered line reader for non-interactive input (scripts, -c strings and
+// pipes). Lines are returned in place from a large buffer, so reading a script
+// costs one read() per INPUT_BUFFER_SIZE bytes and no per-line allocation.
+
+#define INPUT_BUFFER_SIZE (256 * 1024)
+
+input_reader* script_input = NULL;
+int interactive = 1;
+
+static input_reader* input_new(int fd, size_t size) {
+    input_reader* in = malloc(sizeof(input_reader));
+    in->fd = fd;
+    in->size = size;
+    in->buf = malloc(size + 1);
+    in->start = 0;
+    in->end = 0;
+    in->eof = 0;
+    return in;
+}
+
+input_reader* input_open_fd(int fd) {
+    return input_new(fd, INPUT_BUFFER_SIZE);
+}
+
+input_reader* input_open_string(const char* s) {
+    size_t len = strlen(s);
+    input_reader* in = input_new(-1, len);
+    memcpy(in->buf, s, len);
+    in->end = len;
+    in->eof = 1;
+    return in;
+}
+
+void input_close(input_reader* in) {
+    if (in->fd > STDERR_FILENO) {
+        close(in->fd);
+    }
+    free(in->buf);
+    free(in);
+}
+
+// Returns the next line without its newline, or NULL at end of input. The
+// line stays valid until the next call.
+char* input_read_line(input_reader* in) {
+    while (1) {
+        char* line = in->buf + in->start;
+        char* newline = memchr(line, '\n', in->end - in->start);
+        if (newline != NULL) {
+            *newline = '\0';
+            in->start = newline + 1 - in->buf;
+            return line;
+        }
+
+        if (in->eof) {
+            // Last line without a trailing newline
+            if (in->start == in->end) {
+                return NULL;
+            }
+            in->buf[in->end] = '\0';
+            in->start = in->end;
+            return line;
+        }
+
+        // Move the partial line to the front, growing the buffer if the line
+        // alone fills it, then read more
+        if (in->start > 0) {
+            memmove(in->buf, in->buf + in->start, in->end - in->start);
+            in->end -= in->start;
+            in->start = 0;
+        } else if (in->end == in->size) {
+            in->size *= 2;
+            in->buf = realloc(in->buf, in->size + 1);
+        }
+
+        ssize_t n = read(in->fd, in->buf + in->end, in->size - in->end);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            perror("read failed");
+            in->eof = 1;
+        } else if (n == 0) {
+            in->eof = 1;
+        } else {
+            in->end += n;
+        }
+    }
+}
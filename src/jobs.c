@@ -0,0 +1,544 @@
+#include "shell.h"
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+// Background job table.
+//
+// Jobs live in a slot map: a growable array of slots plus a free list, so
+// adding and removing a job never shifts other entries and a job keeps its
+// number for its whole life (number = slot index + 1). A separate
+// open-addressing index maps pid -> slot so a reaped child is matched in O(1).
+//
+// At most jobs_limit() background jobs run at once (jobs -j N, by default
+// the number of CPUs the shell may use). Jobs submitted beyond that wait in
+// a FIFO queue, holding a copy of their words and placement, and start as
+// running jobs finish.
+//
+// Children are reaped as soon as they exit. While a command runs, SIGCHLD
+// only sets a flag and the waitpid() calls happen in wait_for_children(),
+// which every foreground wait goes through. At the prompt SIGCHLD arrives
+// through the event loop's signalfd, which calls jobs_report_at_prompt().
+
+#define PID_EMPTY -1
+#define PID_DELETED -2
+
+static job* job_slots = NULL;
+static int job_capacity = 0;
+static int job_free_head = -1;
+static int job_slots_used = 0;    // slots ever handed out (high-water mark)
+int job_count = 0;                // jobs currently in the table
+
+static int* pid_index = NULL;     // slot numbers, PID_EMPTY or PID_DELETED
+static int pid_index_size = 0;
+static int pid_index_filled = 0;  // live entries plus tombstones
+
+struct queued_job {
+    char** argv;
+    placement where;
+};
+
+static int job_limit = 0;          // 0 until set or first needed
+static int jobs_running = 0;
+static int queue_head = -1;        // slots, linked through next_queued
+static int queue_tail = -1;
+
+static volatile sig_atomic_t sigchld_pending = 0;
+static int at_prompt = 0;         // notifications go above the edited line
+static int reported_at_prompt = 0;
+static int prompt_number = 1;     // prompts shown, counting this one
+
+static double timespec_diff(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void sigchld_handler(int sig) {
+    (void)sig;
+    sigchld_pending = 1;
+}
+
+void jobs_init() {
+    struct sigaction sa;
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP | SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+// pid index
+
+static unsigned int pid_hash(pid_t pid) {
+    return (unsigned int)pid * 2654435761u;
+}
+
+static void pid_index_rebuild(int size) {
+    free(pid_index);
+    pid_index_size = size;
+    pid_index = malloc(sizeof(int) * size);
+    for (int i = 0; i < size; i++) {
+        pid_index[i] = PID_EMPTY;
+    }
+    pid_index_filled = 0;
+
+    for (int slot = 0; slot < job_slots_used; slot++) {
+        if (job_slots[slot].state != JOB_RUNNING) continue;
+        unsigned int i = pid_hash(job_slots[slot].pid) & (size - 1);
+        while (pid_index[i] != PID_EMPTY) {
+            i = (i + 1) & (size - 1);
+        }
+        pid_index[i] = slot;
+        pid_index_filled++;
+    }
+}
+
+// Returns the index position holding pid, or -1
+static int pid_index_find(pid_t pid) {
+    if (pid_index_size == 0) {
+        return -1;
+    }
+    unsigned int mask = pid_index_size - 1;
+    unsigned int i = pid_hash(pid) & mask;
+    while (pid_index[i] != PID_EMPTY) {
+        if (pid_index[i] >= 0 && job_slots[pid_index[i]].pid == pid) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static void pid_index_insert(int slot) {
+    if ((pid_index_filled + 1) * 2 > pid_index_size) {
+        int size = pid_index_size ? pid_index_size : 32;
+        while (size < (job_count + 1) * 4) size *= 2;
+        pid_index_rebuild(size);
+    }
+    unsigned int mask = pid_index_size - 1;
+    unsigned int i = pid_hash(job_slots[slot].pid) & mask;
+    while (pid_index[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    if (pid_index[i] == PID_EMPTY) {
+        pid_index_filled++;
+    }
+    pid_index[i] = slot;
+}
+
+// Job table
+
+job* job_get(int id) {
+    if (id < 1 || id > job_slots_used || job_slots[id - 1].state == JOB_FREE) {
+        return NULL;
+    }
+    return &job_slots[id - 1];
+}
+
+// Make sure job_new() has a slot to hand out. Returns -1 if the table
+// cannot grow.
+static int job_reserve() {
+    if (job_free_head != -1 || job_slots_used < job_capacity) {
+        return 0;
+    }
+    int capacity = job_capacity ? job_capacity * 2 : 16;
+    job* grown = realloc(job_slots, sizeof(job) * capacity);
+    if (grown == NULL) {
+        perror("realloc failed");
+        return -1;
+    }
+    job_slots = grown;
+    job_capacity = capacity;
+    return 0;
+}
+
+// A free slot, initialized for a job running or queued to run arglist, or
+// NULL if there is none
+static job* job_new(char** arglist) {
+    if (job_reserve() == -1) {
+        return NULL;
+    }
+    int slot;
+    if (job_free_head != -1) {
+        slot = job_free_head;
+        job_free_head = job_slots[slot].next_free;
+    } else {
+        slot = job_slots_used++;
+    }
+
+    job* j = &job_slots[slot];
+    memset(j, 0, sizeof(*j));
+    j->id = slot + 1;
+    j->next_free = -1;
+    j->next_queued = -1;
+    clock_gettime(CLOCK_MONOTONIC, &j->queued);
+    j->start = j->queued;
+
+    char cmd_buf[MAX_LEN] = "";
+    int len = 0;
+    for (int i = 0; arglist[i] != NULL && i < 10 && len < MAX_LEN; i++) {
+        len += snprintf(cmd_buf + len, MAX_LEN - len, i > 0 ? " %s" : "%s", arglist[i]);
+    }
+    j->command = strdup(cmd_buf);
+    j->placement = placement_describe();
+    job_count++;
+    return j;
+}
+
+// Record a new, already running background job and return its number
+int add_job(pid_t pid, char** arglist) {
+    job* j = job_new(arglist);
+    if (j == NULL) {
+        return -1;
+    }
+    j->pid = pid;
+    j->state = JOB_RUNNING;
+    jobs_running++;
+    pid_index_insert(j->id - 1);
+    return j->id;
+}
+
+int jobs_limit() {
+    if (job_limit == 0) {
+        cpu_set_t cpus;
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+            job_limit = CPU_COUNT(&cpus);
+        }
+        if (job_limit <= 0) {
+            job_limit = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+        }
+    }
+    return job_limit;
+}
+
+static void jobs_start_queued();
+static void job_finished(job* j);
+
+// jobs -j N; a higher limit starts queued jobs right away
+void jobs_set_limit(int limit) {
+    job_limit = limit;
+    jobs_start_queued();
+}
+
+// Start arglist in the background now, or queue it if the limit is
+// reached. Returns the job number, or -1 if it could not be started.
+int job_submit(char** arglist) {
+    // Room in the table first, so a started job is never lost
+    if (job_reserve() == -1) {
+        return -1;
+    }
+    if (queue_head == -1 && jobs_running < jobs_limit()) {
+        pid_t pid = spawn_background(arglist);
+        return pid < 0 ? -1 : add_job(pid, arglist);
+    }
+
+    job* j = job_new(arglist);
+    if (j == NULL) {
+        return -1;
+    }
+    j->state = JOB_QUEUED;
+    j->pending = malloc(sizeof(struct queued_job));
+    int count = 0;
+    while (arglist[count] != NULL) count++;
+    j->pending->argv = malloc(sizeof(char*) * (count + 1));
+    for (int i = 0; i <= count; i++) {
+        j->pending->argv[i] = arglist[i] ? strdup(arglist[i]) : NULL;
+    }
+    j->pending->where = job_placement;
+
+    if (queue_tail == -1) {
+        queue_head = j->id - 1;
+    } else {
+        job_slots[queue_tail].next_queued = j->id - 1;
+    }
+    queue_tail = j->id - 1;
+    return j->id;
+}
+
+static void free_pending(job* j) {
+    for (char** word = j->pending->argv; *word != NULL; word++) {
+        free(*word);
+    }
+    free(j->pending->argv);
+    free(j->pending);
+    j->pending = NULL;
+}
+
+// Start queued jobs, oldest first, while there is room
+static void jobs_start_queued() {
+    while (queue_head != -1 && jobs_running < jobs_limit()) {
+        job* j = &job_slots[queue_head];
+        queue_head = j->next_queued;
+        if (queue_head == -1) {
+            queue_tail = -1;
+        }
+
+        // Run with the placement it was submitted under
+        placement saved = job_placement;
+        job_placement = j->pending->where;
+        pid_t pid = spawn_background(j->pending->argv);
+        job_placement = saved;
+        free_pending(j);
+
+        clock_gettime(CLOCK_MONOTONIC, &j->start);
+        if (pid < 0) {
+            j->state = JOB_DONE;
+            j->status = 127;
+            j->end = j->start;
+            job_finished(j);
+            continue;
+        }
+        j->pid = pid;
+        j->state = JOB_RUNNING;
+        jobs_running++;
+        pid_index_insert(j->id - 1);
+    }
+}
+
+void remove_job(job* j) {
+    // A done job's pid is out of the index and may belong to a newer job
+    int pos = pid_index_find(j->pid);
+    if (pos >= 0 && pid_index[pos] == j->id - 1) {
+        pid_index[pos] = PID_DELETED;
+    }
+    if (j->pending != NULL) {
+        free_pending(j);
+    }
+    free(j->command);
+    free(j->placement);
+    j->command = NULL;
+    j->placement = NULL;
+    j->state = JOB_FREE;
+    j->next_free = job_free_head;
+    job_free_head = j->id - 1;
+    job_count--;
+}
+
+// Run time so far, and the time spent queued if there was any
+static void print_job_times(const job* j, const struct timespec* until) {
+    double waited = timespec_diff(&j->queued, &j->start);
+    if (waited > 0) {
+        printf(" (%.1fs, queued %.1fs)", timespec_diff(&j->start, until), waited);
+    } else {
+        printf(" (%.1fs)", timespec_diff(&j->start, until));
+    }
+}
+
+static void print_job(const job* j) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (j->state == JOB_QUEUED) {
+        printf("[%d] Queued  %s (waiting %.1fs)", j->id, j->command, timespec_diff(&j->queued, &now));
+    } else if (j->state == JOB_RUNNING) {
+        printf("[%d] Running %d %s", j->id, j->pid, j->command);
+        print_job_times(j, &now);
+    } else if (j->status == 0) {
+        printf("[%d] Done    %d %s", j->id, j->pid, j->command);
+        print_job_times(j, &j->end);
+    } else {
+        printf("[%d] Exit %-3d %d %s", j->id, j->status, j->pid, j->command);
+        print_job_times(j, &j->end);
+    }
+    if (j->placement != NULL && j->state != JOB_DONE) {
+        printf(" [%s]", j->placement);
+    }
+    printf("\n");
+}
+
+// A child that is not part of the current foreground command has exited.
+// If it is a background job, record the result and report it right away.
+static void job_exited(pid_t pid, int status) {
+    if (trace_enabled) {
+        trace_child_end(pid, status);
+    }
+    int pos = pid_index_find(pid);
+    if (pos < 0) {
+        return;
+    }
+    job* j = &job_slots[pid_index[pos]];
+    pid_index[pos] = PID_DELETED;  // the pid may be reused from now on
+    j->state = JOB_DONE;
+    j->status = wait_status(status);
+    clock_gettime(CLOCK_MONOTONIC, &j->end);
+    jobs_running--;
+    job_finished(j);
+    jobs_start_queued();
+}
+
+// A job is done: report it when interactive and keep it for jobs to list
+// until jobs_next_prompt() lets it go. Nothing reports a script's jobs, so
+// theirs are freed right away.
+static void job_finished(job* j) {
+    if (!interactive) {
+        remove_job(j);
+        return;
+    }
+    if (at_prompt && reported_at_prompt++ == 0) {
+        rl_clear_visible_line();
+    }
+    print_job(j);
+    fflush(stdout);
+    j->reported = prompt_number;
+}
+
+// A new prompt is about to be shown. Finished jobs stay listed through the
+// command line after the one they were reported during, then their slots
+// are freed, so a shell that starts many jobs keeps only a few done ones.
+void jobs_next_prompt() {
+    prompt_number++;
+    for (int i = 0; i < job_slots_used; i++) {
+        job* j = &job_slots[i];
+        if (j->state == JOB_DONE && j->reported > 0 && j->reported < prompt_number - 1) {
+            remove_job(j);
+        }
+    }
+}
+
+// Reap every child that has already exited, without blocking
+void cleanup_background_jobs() {
+    int status;
+    pid_t pid;
+
+    sigchld_pending = 0;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        job_exited(pid, status);
+    }
+}
+
+// Report jobs that finished while a line is being edited: the prompt and
+// the partial line are erased, the notices printed in their place and the
+// line redrawn below them as it was.
+void jobs_report_at_prompt() {
+    at_prompt = 1;
+    reported_at_prompt = 0;
+    cleanup_background_jobs();
+    at_prompt = 0;
+    if (reported_at_prompt > 0) {
+        rl_forced_update_display();
+    }
+}
+
+// Wait until every pid in pids has exited, storing each wait status (and,
+// if usages is not NULL, its resource usage) in the matching slot.
+// Background jobs that finish in the meantime are reaped and reported
+// immediately rather than left as zombies.
+void wait_for_children(pid_t* pids, int* statuses, struct rusage* usages, int count) {
+    uint64_t trace_start_ns = trace_enabled ? trace_now() : 0;
+    int remaining = 0;
+    for (int i = 0; i < count; i++) {
+        if (pids[i] > 0) remaining++;
+    }
+
+    while (remaining > 0) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-1, &status, 0, &ru);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        int matched = 0;
+        for (int i = 0; i < count; i++) {
+            if (pids[i] == pid) {
+                statuses[i] = status;
+                if (usages != NULL) {
+                    usages[i] = ru;
+                }
+                acct_add(&ru);
+                if (trace_enabled) {
+                    trace_child_end(pid, status);
+                }
+                remaining--;
+                matched = 1;
+                break;
+            }
+        }
+        if (!matched) {
+            job_exited(pid, status);
+        }
+    }
+    if (trace_enabled) {
+        trace_span("wait", "wait", trace_start_ns, NULL);
+    }
+}
+
+// Wait until any one of pids (entries <= 0 are ignored) exits. Returns its
+// index and stores its wait status, or -1 if there is nothing to wait for.
+int wait_for_any(pid_t* pids, int count, int* status) {
+    while (1) {
+        struct rusage ru;
+        pid_t pid = wait4(-1, status, 0, &ru);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (pids[i] == pid) {
+                acct_add(&ru);
+                if (trace_enabled) {
+                    trace_child_end(pid, *status);
+                }
+                return i;
+            }
+        }
+        job_exited(pid, *status);
+    }
+}
+
+int wait_for_child(pid_t pid) {
+    int status = 0;
+    wait_for_children(&pid, &status, NULL, 1);
+    return status;
+}
+
+// Wait for every running and queued job, e.g. before the shell exits
+void wait_for_all_jobs() {
+    while (1) {
+        jobs_start_queued();
+        if (jobs_running == 0) {
+            return;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        job_exited(pid, status);
+    }
+}
+
+// Wait until every queued job has started, so a script's queue is not lost
+// when it ends
+void jobs_drain_queue() {
+    while (queue_head != -1) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            // No children left: whatever is queued can start now
+            jobs_start_queued();
+            continue;
+        }
+        job_exited(pid, status);
+    }
+}
+
+// Show every job; finished ones are listed once and then freed
+void print_jobs() {
+    cleanup_background_jobs();
+
+    if (job_count == 0) {
+        printf("No background jobs\n");
+        return;
+    }
+
+    for (int i = 0; i < job_slots_used; i++) {
+        job* j = &job_slots[i];
+        if (j->state == JOB_FREE) continue;
+        print_job(j);
+        if (j->state == JOB_DONE) {
+            remove_job(j);
+        }
+    }
+}
@@ -0,0 +1,314 @@
+#include "shell.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// The command line lexer. The line is classified 64 bytes at a time into a
+// bitmask of stop bytes, the bytes that can end or change a word (blanks,
+// quotes, '$', operators and the terminating '\0'); the lexer then steps
+// from stop to stop with a count of trailing zeros, and copies everything
+// in between with one memcpy. On x86-64 a block is classified with SSE2 (4
+// loads) or AVX2 (2 loads), elsewhere by a table-driven scalar loop. There
+// is no limit on the length of a line or the number of words: the token
+// array grows in command_arena. All state lives in a lex_cursor on the
+// caller's stack, so the lexer is reentrant.
+//
+// Blocks are read from 64-byte aligned addresses, so classifying one never
+// touches a page past the one holding the terminating '\0'.
+
+enum {
+    LEX_WORD,    // lexing words: blanks and operators end them
+    LEX_QUOTED,  // inside "...": only the closing quote and $( matter
+    LEX_CHAIN,   // splitting a ';' chain
+    LEX_CLASSES
+};
+
+// Stop bytes of each class, as a bit per class
+static const unsigned char lex_stops[256] = {
+    [0] = 7, ['"'] = 7, ['$'] = 7, [';'] = 5, [' '] = 1, ['\t'] = 1,
+    ['<'] = 1, ['>'] = 1, ['|'] = 1, ['&'] = 1,
+};
+
+typedef struct {
+    const char* base;             // the 64-byte block the masks describe
+    uint64_t mask[LEX_CLASSES];   // its stop bytes, per class
+} lex_cursor;
+
+// Stop bytes of the block at base, from byte from on. The scalar version
+// reads nothing before from or after a '\0'.
+static void block_scalar(const char* base, int from, uint64_t* mask) {
+    mask[LEX_WORD] = mask[LEX_QUOTED] = mask[LEX_CHAIN] = 0;
+    for (int i = from; i < 64; i++) {
+        unsigned char stops = lex_stops[(unsigned char)base[i]];
+        if (stops) {
+            uint64_t bit = (uint64_t)1 << i;
+            mask[LEX_WORD] |= bit;
+            if (stops & 2) mask[LEX_QUOTED] |= bit;
+            if (stops & 4) mask[LEX_CHAIN] |= bit;
+            if (base[i] == '\0') break;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+// The SIMD classifiers read the whole aligned block around the string,
+// which can start before it and run past its '\0' into memory malloc or
+// the arena never handed out. That is safe: an aligned 64-byte block never
+// spans two pages, and the bytes outside the string only set mask bits the
+// cursor never looks at (those before p are masked off, and nothing past
+// the '\0' is asked for). AddressSanitizer cannot know that, so it is kept
+// out of these functions.
+#define LEX_NO_ASAN __attribute__((no_sanitize_address))
+
+LEX_NO_ASAN static inline void stops_sse2(const char* p, int shift, uint64_t* mask) {
+    __m128i v = _mm_load_si128((const __m128i*)p);
+    __m128i quoted = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    quoted = _mm_or_si128(quoted, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    __m128i chain = _mm_or_si128(quoted, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    __m128i word = _mm_or_si128(chain, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    word = _mm_or_si128(word, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    word = _mm_or_si128(word, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    word = _mm_or_si128(word, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    // '<' and '>' differ only in bit 1
+    word = _mm_or_si128(word, _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(2)), _mm_set1_epi8('>')));
+    mask[LEX_WORD] |= (uint64_t)(uint32_t)_mm_movemask_epi8(word) << shift;
+    mask[LEX_QUOTED] |= (uint64_t)(uint32_t)_mm_movemask_epi8(quoted) << shift;
+    mask[LEX_CHAIN] |= (uint64_t)(uint32_t)_mm_movemask_epi8(chain) << shift;
+}
+
+LEX_NO_ASAN static void block_sse2(const char* base, int from, uint64_t* mask) {
+    (void)from;
+    mask[LEX_WORD] = mask[LEX_QUOTED] = mask[LEX_CHAIN] = 0;
+    for (int i = 0; i < 64; i += 16) {
+        stops_sse2(base + i, i, mask);
+    }
+}
+
+LEX_NO_ASAN __attribute__((target("avx2"))) static inline void stops_avx2(const char* p, int shift,
+                                                                      uint64_t* mask) {
+    __m256i v = _mm256_load_si256((const __m256i*)p);
+    __m256i quoted = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    quoted = _mm256_or_si256(quoted, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')));
+    __m256i chain = _mm256_or_si256(quoted, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    __m256i word = _mm256_or_si256(chain, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    word = _mm256_or_si256(word, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    word = _mm256_or_si256(word, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+    word = _mm256_or_si256(word, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+    word = _mm256_or_si256(word, _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(2)), _mm256_set1_epi8('>')));
+    mask[LEX_WORD] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(word) << shift;
+    mask[LEX_QUOTED] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(quoted) << shift;
+    mask[LEX_CHAIN] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(chain) << shift;
+}
+
+LEX_NO_ASAN __attribute__((target("avx2"))) static void block_avx2(const char* base, int from, uint64_t* mask) {
+    (void)from;
+    mask[LEX_WORD] = mask[LEX_QUOTED] = mask[LEX_CHAIN] = 0;
+    stops_avx2(base, 0, mask);
+    stops_avx2(base + 32, 32, mask);
+}
+#endif
+
+static void (*lex_block)(const char* base, int from, uint64_t* mask) = NULL;
+
+// Choose the block classifier: "scalar", "sse2", "avx2", or NULL for the
+// best this CPU supports. Returns -1 if the named one is not available here.
+int lexer_select(const char* name) {
+    void (*block)(const char*, int, uint64_t*) = block_scalar;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    int avx2 = __builtin_cpu_supports("avx2");
+    if (name == NULL) {
+        block = avx2 ? block_avx2 : block_sse2;
+    } else if (strcmp(name, "sse2") == 0) {
+        block = block_sse2;
+    } else if (strcmp(name, "avx2") == 0) {
+        if (!avx2) return -1;
+        block = block_avx2;
+    } else if (strcmp(name, "scalar") != 0) {
+        return -1;
+    }
+#else
+    if (name != NULL && strcmp(name, "scalar") != 0) {
+        return -1;
+    }
+#endif
+    lex_block = block;
+    return 0;
+}
+
+static void cursor_init(lex_cursor* c) {
+    if (lex_block == NULL) {
+        lexer_select(NULL);
+    }
+    c->base = NULL;
+}
+
+// The first stop byte of class at or after p. p only moves forward.
+static const char* cursor_next(lex_cursor* c, const char* p, int class) {
+    const char* base = (const char*)((uintptr_t)p & ~(uintptr_t)63);
+    int from = p - base;
+    if (base != c->base) {
+        c->base = base;
+        lex_block(base, from, c->mask);
+    }
+    uint64_t mask = c->mask[class] & (~(uint64_t)0 << from);
+    while (mask == 0) {
+        c->base += 64;
+        lex_block(c->base, 0, c->mask);
+        mask = c->mask[class];
+    }
+    return c->base + __builtin_ctzll(mask);
+}
+
+static int is_operator_char(char c) {
+    return c == '<' || c == '>' || c == '|' || c == '&' || c == ';';
+}
+
+// Find the end of the word at cp; quoted sections and $(...) may contain
+// blanks and operators. Sets *quoted if the word has quote characters.
+static const char* word_end(lex_cursor* c, const char* cp, int* quoted) {
+    int in_quotes = 0;
+    while (1) {
+        cp = cursor_next(c, cp, in_quotes ? LEX_QUOTED : LEX_WORD);
+        if (*cp == '$') {
+            size_t substitution = substitution_length(cp);
+            cp += substitution > 0 ? substitution : 1;
+        } else if (*cp == '"') {
+            in_quotes = !in_quotes;
+            *quoted = 1;
+            cp++;
+        } else if (*cp == '\0' || !in_quotes) {
+            return cp;
+        } else {
+            cp++;
+        }
+    }
+}
+
+// Copy the word from start to end without its quote characters; a $(...)
+// is kept as written for expansion
+static char* word_copy(const char* start, const char* end, int quoted) {
+    char* word = arena_alloc(&command_arena, end - start + 1);
+    if (!quoted) {
+        memcpy(word, start, end - start);
+        word[end - start] = '\0';
+        return word;
+    }
+    lex_cursor c;
+    cursor_init(&c);
+    size_t len = 0;
+    const char* p = start;
+    while (p < end) {
+        const char* stop = cursor_next(&c, p, LEX_QUOTED);
+        if (stop > end) stop = end;
+        memcpy(word + len, p, stop - p);
+        len += stop - p;
+        p = stop;
+        if (p == end) break;
+        if (*p == '"') {
+            p++;
+            continue;
+        }
+        size_t substitution = substitution_length(p);
+        size_t keep = substitution > 0 ? substitution : 1;
+        memcpy(word + len, p, keep);
+        len += keep;
+        p += keep;
+    }
+    word[len] = '\0';
+    return word;
+}
+
+// Split cmdline into words and operators. Tokens and the token array live
+// in command_arena and are released together when the command finishes.
+char** lex_words(const char* cmdline) {
+    if (cmdline == NULL || cmdline[0] == '\0' || cmdline[0] == '\n') {
+        return NULL;
+    }
+
+    int capacity = 64;
+    char** arglist = arena_alloc(&command_arena, sizeof(char*) * capacity);
+    int argnum = 0;
+    const char* cp = cmdline;
+    lex_cursor c;
+    cursor_init(&c);
+
+    while (1) {
+        while (*cp == ' ' || *cp == '\t') cp++;
+        if (*cp == '\0') break;
+
+        if (argnum + 1 >= capacity) {
+            char** grown = arena_alloc(&command_arena, sizeof(char*) * capacity * 2);
+            memcpy(grown, arglist, sizeof(char*) * argnum);
+            arglist = grown;
+            capacity *= 2;
+        }
+
+        // Redirections keep their descriptor number and &M: 2>&1, >>, <<<
+        size_t redirection = redirection_length(cp);
+        if (redirection > 0) {
+            arglist[argnum++] = arena_strndup(&command_arena, cp, redirection);
+            cp += redirection;
+            continue;
+        }
+
+        if (is_operator_char(*cp)) {
+            arglist[argnum++] = arena_strndup(&command_arena, cp, 1);
+            cp++;
+            continue;
+        }
+
+        int quoted = 0;
+        const char* end = word_end(&c, cp, &quoted);
+        // A quoted here-document delimiter keeps the body from being expanded
+        if (quoted && argnum > 0 && redirection_kind(arglist[argnum - 1]) == REDIR_HEREDOC) {
+            arglist[argnum - 1] = heredoc_literal(arglist[argnum - 1]);
+        }
+        arglist[argnum++] = word_copy(cp, end, quoted);
+        cp = end;
+    }
+
+    if (argnum == 0) {
+        return NULL;
+    }
+
+    arglist[argnum] = NULL;
+    heredoc_collect(arglist);
+    return arglist;
+}
+
+// Cut the next command off a ';' chain at the first ';' outside quotes and
+// $(...). Returns NULL when the chain is used up.
+char* chain_next(char** rest) {
+    char* command = *rest;
+    if (command == NULL) {
+        return NULL;
+    }
+    lex_cursor c;
+    cursor_init(&c);
+    int in_quotes = 0;
+    char* cp = command;
+    while (1) {
+        cp = (char*)cursor_next(&c, cp, in_quotes ? LEX_QUOTED : LEX_CHAIN);
+        if (*cp == '\0') {
+            break;
+        }
+        if (*cp == '$') {
+            size_t substitution = substitution_length(cp);
+            cp += substitution > 0 ? substitution : 1;
+        } else if (*cp == '"') {
+            in_quotes = !in_quotes;
+            cp++;
+        } else if (*cp == ';' && !in_quotes) {
+            *cp = '\0';
+            *rest = cp + 1;
+            return command;
+        } else {
+            cp++;
+        }
+    }
+    *rest = NULL;
+    return command;
+}
@@ -1,72 +1,331 @@
 #include "shell.h"
 
-int main() {
+static int run_command_line(char* cmdline);
+
+// If line starts with the word, move past it and any following blanks
+static int take_word(char** line, const char* word) {
+    size_t len = strlen(word);
+    char* p = *line;
+    if (strncmp(p, word, len) != 0 || (p[len] != '\0' && p[len] != ' ' && p[len] != '\t')) {
+        return 0;
+    }
+    p += len;
+    while (*p == ' ' || *p == '\t') p++;
+    *line = p;
+    return 1;
+}
+
+// Cut the next blank-separated word off *line
+static char* cut_word(char** line) {
+    char* word = *line;
+    char* p = word;
+    while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+    if (*p != '\0') {
+        *p++ = '\0';
+        while (*p == ' ' || *p == '\t') p++;
+    }
+    *line = p;
+    return word;
+}
+
+// Run a line that has already been recorded in history. Memory it takes
+// from command_arena is released by the caller.
+static int dispatch_line(char* line) {
+    // pin CPUS, nice [-n N] and cg PATH [command line]: where and at what
+    // priority the processes started by the rest of the line run
+    int pin = 0;
+    int cg = 0;
+    if ((pin = take_word(&line, "pin")) || (cg = take_word(&line, "cg")) || take_word(&line, "nice")) {
+        placement saved = job_placement;
+        int failed;
+        if (pin || cg) {
+            char* arg = cut_word(&line);
+            failed = pin ? placement_set_cpus(arg) : placement_set_cgroup(arg);
+        } else {
+            failed = placement_set_nice(&line);
+        }
+        if (failed) {
+            last_status = 2;
+        } else if (*line != '\0') {
+            dispatch_line(line);
+        }
+        job_placement = saved;
+        return last_status;
+    }
+
+    // pipesize SIZE [command line]: pipe capacity for the rest of the line
+    if (take_word(&line, "pipesize")) {
+        char* size = cut_word(&line);
+        long bytes = parse_size(size);
+        if (bytes == 0) {
+            fprintf(stderr, "pipesize: %s: invalid size\n", size);
+            last_status = 2;
+            return last_status;
+        }
+        long saved = pipe_size_override;
+        pipe_size_override = bytes;
+        if (*line != '\0') {
+            dispatch_line(line);
+        }
+        pipe_size_override = saved;
+        return last_status;
+    }
+
+    // meter [command line]: report per-stage throughput of its pipelines
+    if (take_word(&line, "meter")) {
+        int saved = pipe_meter_override;
+        pipe_meter_override = 1;
+        if (*line != '\0') {
+            dispatch_line(line);
+        }
+        pipe_meter_override = saved;
+        return last_status;
+    }
+
+    // time [command line]: report the resources the rest of the line used
+    if (take_word(&line, "time")) {
+        acct_frame frame;
+        acct_timing_begin(&frame);
+        if (*line != '\0') {
+            dispatch_line(line);
+        }
+        acct_timing_end(&frame);
+        return last_status;
+    }
+
+    // parallel [-j N]: run a block or chain with N commands at a time
+    if (take_word(&line, "parallel")) {
+        handle_parallel(line, dispatch_line);
+        return last_status;
+    }
+
+    // Control structures: if, while and for
+    if (is_compound_start(line)) {
+        handle_compound(line, dispatch_line);
+        return last_status;
+    }
+
+    // Handle command chaining
+    if (strchr(line, ';') != NULL) {
+        handle_chain_commands(line, dispatch_line);
+        return last_status;
+    }
+
+    if (line[0] == '!') {
+        int hist_num;
+        if (sscanf(line + 1, "%d", &hist_num) == 1) {
+            char* replayed = history_entry(hist_num);
+            if (replayed != NULL) {
+                printf("%s\n", replayed);
+                run_command_line(replayed);
+                free(replayed);
+            }
+        } else {
+            printf("Invalid history command. Use !n where n is history number.\n");
+        }
+        return last_status;
+    }
+
+    char** arglist = tokenize(line);
+    if (arglist != NULL) {
+        if (!handle_builtin(arglist)) {
+            execute(arglist);
+        }
+    }
+    return last_status;
+}
+
+// Run a top-level line and release everything it allocated. Lines run from
+// inside a compound command, parallel or $(...) go through dispatch_line,
+// which leaves command_arena alone: the caller may still be walking a parse
+// tree that lives there.
+static int dispatch_top_level(char* line) {
+    dispatch_line(line);
+    arena_reset(&command_arena);
+    return last_status;
+}
+
+// Dispatch a line, recording it as one span when tracing
+static void run_traced_line(char* line, int top_level) {
+    if (!top_level) {
+        dispatch_line(line);
+        return;
+    }
+    if (!trace_enabled) {
+        dispatch_top_level(line);
+        return;
+    }
+    char* traced = strdup(line);
+    uint64_t start = trace_now();
+    dispatch_top_level(line);
+    trace_span("line", "line", start, traced);
+    free(traced);
+}
+
+// Run one command line. Returns the exit status of the line.
+static int run_command_line(char* cmdline) {
+    static int depth = 0;
+
+    // Skip blank lines and comments, including a script's #! line
+    char* line = cmdline;
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '#') {
+        return last_status;
+    }
+
+    // Every interactive line except !n is recorded, before it runs
+    if (interactive) {
+        add_to_history(line);
+    }
+
+    // With MYSHELL_TIMELOG set, log the resources of every top-level line
+    const char* log_path = depth == 0 ? var_get("MYSHELL_TIMELOG") : NULL;
+    if (log_path == NULL || *log_path == '\0') {
+        depth++;
+        run_traced_line(line, depth == 1);
+        depth--;
+        return last_status;
+    }
+
+    char* logged = strdup(line);
+    acct_frame frame;
+    acct_begin(&frame);
+    depth++;
+    run_traced_line(line, 1);
+    depth--;
+    acct_end(&frame);
+    acct_log(log_path, &frame, last_status, logged);
+    free(logged);
+    return last_status;
+}
+
+// Run every line of a script, -c string or piped input. No readline, prompt
+// or banner; the exit status is that of the last command.
+static int run_script() {
+    char* cmdline;
+    while ((cmdline = input_read_line(script_input)) != NULL) {
+        run_command_line(cmdline);
+    }
+    input_close(script_input);
+    script_input = NULL;
+    jobs_drain_queue();
+    return last_status;
+}
+
+// Expose the script name and its arguments as $0, $1...
+static void set_positional_parameters(int argc, char* argv[]) {
+    char name[16];
+    for (int i = 0; i < argc; i++) {
+        snprintf(name, sizeof(name), "%d", i);
+        var_set(name, strlen(name), argv[i], 0);
+    }
+}
+
+// --startup-profile: time each initialization phase and print the table
+// to stderr before the first command runs
+#define STARTUP_PHASES 8
+
+static int startup_profile = 0;
+static int startup_count = 0;
+static const char* startup_names[STARTUP_PHASES];
+static struct timespec startup_times[STARTUP_PHASES + 1];
+
+static void startup_phase(const char* name) {
+    if (startup_profile && startup_count < STARTUP_PHASES) {
+        startup_names[startup_count] = name;
+        clock_gettime(CLOCK_MONOTONIC, &startup_times[++startup_count]);
+    }
+}
+
+static void startup_report() {
+    if (!startup_profile) {
+        return;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double total = 0;
+    fprintf(stderr, "%-16s %10s\n", "startup phase", "usec");
+    for (int i = 0; i < startup_count; i++) {
+        double usec = (startup_times[i + 1].tv_sec - startup_times[i].tv_sec) * 1e6 +
+                      (startup_times[i + 1].tv_nsec - startup_times[i].tv_nsec) / 1e3;
+        total += usec;
+        fprintf(stderr, "%-16s %10.1f\n", startup_names[i], usec);
+    }
+    fprintf(stderr, "%-16s %10.1f\n", "total (in main)", total);
+    fprintf(stderr, "%-16s %10ld\n", "page faults", usage.ru_minflt + usage.ru_majflt);
+    startup_profile = 0;
+}
+
+int main(int argc, char* argv[]) {
     char* cmdline;
-    char** arglist;
 
-    rl_bind_key('\t', rl_complete);
-    rl_readline_name = "myshell";
-    
+    if (argc > 1 && strcmp(argv[1], "--startup-profile") == 0) {
+        startup_profile = 1;
+        clock_gettime(CLOCK_MONOTONIC, &startup_times[0]);
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+
+    spawn_init();
+    startup_phase("spawn");
+    variables_init();
+    startup_phase("variables");
+    jobs_init();
+    startup_phase("jobs");
+    substitution_runner = dispatch_line;
+
+    // MYSHELL_TRACE=FILE traces the whole run
+    const char* trace_path = var_get("MYSHELL_TRACE");
+    if (trace_path != NULL && *trace_path != '\0') {
+        trace_start(trace_path);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        script_input = input_open_string(argv[2]);
+        set_positional_parameters(argc - 3, argv + 3);
+    } else if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        fprintf(stderr, "myshell: -c: option requires an argument\n");
+        return 2;
+    } else if (argc > 1) {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            perror(argv[1]);
+            return 127;
+        }
+        script_input = input_open_fd(fd);
+        set_positional_parameters(argc - 1, argv + 1);
+    } else if (!isatty(STDIN_FILENO)) {
+        script_input = input_open_fd(STDIN_FILENO);
+    }
+
+    startup_phase("input");
+
+    if (script_input != NULL) {
+        interactive = 0;
+        startup_report();
+        return run_script();
+    }
+
+    // Readline is otherwise set up by the first prompt
+    if (startup_profile) {
+        readline_init();
+        startup_phase("readline");
+    }
+
     printf("Welcome to MyShell with If-Then-Else Control Structure!\n");
     printf("Type 'help' for more information.\n\n");
+    startup_report();
 
     while (1) {
-        cleanup_background_jobs();
-        
         cmdline = read_cmd(PROMPT, stdin);
-        
+
         if (cmdline == NULL) {
             printf("\nShell exited.\n");
             break;
         }
-        
-        // NEW: Handle if-then-else statements first
-        if (strncmp(cmdline, "if ", 3) == 0) {
-            handle_if_then_else(cmdline);
-            free(cmdline);
-            continue;
-        }
-        
-        // Handle command chaining
-        if (strchr(cmdline, ';') != NULL) {
-            handle_chain_commands(cmdline);
-            free(cmdline);
-            continue;
-        }
-        
-        if (cmdline[0] == '!') {
-            int hist_num;
-            if (sscanf(cmdline + 1, "%d", &hist_num) == 1) {
-                int hist_index = execute_from_history(hist_num);
-                if (hist_index >= 0) {
-                    free(cmdline);
-                    cmdline = strdup(history[hist_index]);
-                    printf("%s\n", cmdline);
-                } else {
-                    free(cmdline);
-                    continue;
-                }
-            } else {
-                printf("Invalid history command. Use !n where n is history number.\n");
-                free(cmdline);
-                continue;
-            }
-        }
-        
-        if (strlen(cmdline) > 0 && cmdline[0] != '!') {
-            add_to_history(cmdline);
-        }
-        
-        if ((arglist = tokenize(cmdline)) != NULL) {
-            if (!handle_builtin(arglist)) {
-                execute(arglist);
-            }
 
-            for (int i = 0; arglist[i] != NULL; i++) {
-                free(arglist[i]);
-            }
-            free(arglist);
-        }
+        run_command_line(cmdline);
         free(cmdline);
     }
 
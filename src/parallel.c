@@ -0,0 +1,193 @@
+#include "shell.h"
+#include <errno.h>
+#include <sys/mman.h>
+
+// Parallel blocks.
+//
+//     parallel [-j N]                  parallel [-j N] cmd1; cmd2; cmd3
+//     cmd1
+//     cmd2
+//     end
+//
+// Runs the commands with at most N at a time (default: one per online CPU),
+// starting the next one as soon as any finishes. Each command runs in a
+// forked copy of the shell, so it can be a pipeline, a builtin or an if
+// block, but variable assignments do not outlive it. Its stdout and stderr
+// are collected in memory files and written out in one piece when it
+// finishes, so the output of different commands never interleaves.
+//
+// The exit status is 0 if every command succeeded, otherwise the number of
+// commands that failed (at most 100).
+
+#define PARALLEL_MAX_STATUS 100
+
+typedef struct {
+    pid_t pid;
+    int out;
+    int err;
+} parallel_slot;
+
+static int parallel_start(parallel_slot* slot, char* command, int (*run)(char*)) {
+    slot->out = memfd_create("parallel-stdout", MFD_CLOEXEC);
+    slot->err = memfd_create("parallel-stderr", MFD_CLOEXEC);
+    if (slot->out == -1 || slot->err == -1) {
+        perror("memfd_create failed");
+        if (slot->out != -1) close(slot->out);
+        if (slot->err != -1) close(slot->err);
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    slot->pid = fork();
+    if (slot->pid == 0) {
+        dup2(slot->out, STDOUT_FILENO);
+        dup2(slot->err, STDERR_FILENO);
+        interactive = 0;
+        int status = run(command);
+        fflush(stdout);
+        _exit(status);
+    }
+    if (slot->pid < 0) {
+        perror("fork failed");
+        close(slot->out);
+        close(slot->err);
+        return -1;
+    }
+    return 0;
+}
+
+// Write out everything a finished command printed
+static void parallel_flush(parallel_slot* slot) {
+    fflush(stdout);
+    lseek(slot->out, 0, SEEK_SET);
+    copy_fd(slot->out, STDOUT_FILENO);
+    lseek(slot->err, 0, SEEK_SET);
+    copy_fd(slot->err, STDERR_FILENO);
+    close(slot->out);
+    close(slot->err);
+}
+
+int run_parallel(char** commands, int count, int max_jobs, int (*run)(char*)) {
+    parallel_slot* slots = arena_alloc(&command_arena, sizeof(parallel_slot) * max_jobs);
+    pid_t* pids = arena_alloc(&command_arena, sizeof(pid_t) * max_jobs);
+    for (int i = 0; i < max_jobs; i++) {
+        pids[i] = 0;
+    }
+
+    int next = 0;
+    int running = 0;
+    int failed = 0;
+    while (next < count || running > 0) {
+        // Fill every free slot
+        for (int i = 0; i < max_jobs && next < count; i++) {
+            if (pids[i] > 0) continue;
+            if (parallel_start(&slots[i], commands[next++], run) == -1) {
+                failed++;
+                continue;
+            }
+            pids[i] = slots[i].pid;
+            running++;
+        }
+        if (running == 0) {
+            break;
+        }
+
+        int status;
+        int done = wait_for_any(pids, max_jobs, &status);
+        if (done < 0) {
+            break;
+        }
+        parallel_flush(&slots[done]);
+        if (wait_status(status) != 0) {
+            failed++;
+        }
+        pids[done] = 0;
+        running--;
+    }
+
+    return failed < PARALLEL_MAX_STATUS ? failed : PARALLEL_MAX_STATUS;
+}
+
+// Read the lines of a parallel block up to its closing "end"
+static char** read_parallel_block(int* count) {
+    int capacity = 16;
+    char** commands = arena_alloc(&command_arena, sizeof(char*) * capacity);
+    *count = 0;
+
+    char* line;
+    while ((line = read_input_line("parallel> ")) != NULL) {
+        if (interactive && *line) {
+            add_history(line);
+        }
+
+        char* trimmed = line;
+        while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
+        char* end = trimmed + strlen(trimmed);
+        while (end > trimmed && (end[-1] == ' ' || end[-1] == '\t')) end--;
+        *end = '\0';
+
+        if (strcmp(trimmed, "end") == 0) {
+            free(line);
+            return commands;
+        }
+        if (*trimmed != '\0' && *trimmed != '#') {
+            if (*count == capacity) {
+                char** grown = arena_alloc(&command_arena, sizeof(char*) * capacity * 2);
+                memcpy(grown, commands, sizeof(char*) * capacity);
+                commands = grown;
+                capacity *= 2;
+            }
+            commands[(*count)++] = arena_strdup(&command_arena, trimmed);
+        }
+        free(line);
+    }
+
+    fprintf(stderr, "Error: 'end' not found to close parallel block\n");
+    return NULL;
+}
+
+// parallel [-j N] [cmd; cmd...]; args is the text after the keyword
+int handle_parallel(char* args, int (*run)(char*)) {
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (strncmp(args, "-j", 2) == 0) {
+        char* number = args + 2;
+        while (*number == ' ' || *number == '\t') number++;
+        char* end;
+        max_jobs = strtol(number, &end, 10);
+        if (end == number || max_jobs <= 0 || (*end != '\0' && *end != ' ' && *end != '\t')) {
+            fprintf(stderr, "parallel: -j needs a positive number\n");
+            last_status = 2;
+            return last_status;
+        }
+        args = end;
+        while (*args == ' ' || *args == '\t') args++;
+    }
+    if (max_jobs <= 0) {
+        max_jobs = 1;
+    }
+
+    char** commands;
+    int count = 0;
+    if (*args == '\0') {
+        commands = read_parallel_block(&count);
+        if (commands == NULL) {
+            last_status = 2;
+            return last_status;
+        }
+    } else {
+        commands = arena_alloc(&command_arena, sizeof(char*) * (strlen(args) / 2 + 1));
+        char* rest = args;
+        char* command;
+        while ((command = chain_next(&rest)) != NULL) {
+            while (*command == ' ' || *command == '\t') command++;
+            if (*command != '\0') {
+                commands[count++] = command;
+            }
+        }
+    }
+
+    last_status = run_parallel(commands, count, max_jobs < count ? max_jobs : (count > 0 ? count : 1), run);
+    return last_status;
+}
@@ -0,0 +1,435 @@
+#include "shell.h"
+
+// Control structures: if/elif/else/fi, while/do/done, for/in/do/done,
+// break and continue.
+//
+// A compound command is parsed once into a tree of nodes before any of it
+// runs. Simple commands are tokenized at parse time, so a loop body runs
+// from the stored tokens on every iteration: each run copies the token
+// pointers (execution rewrites its argument array in place) and releases
+// whatever it allocated with an arena mark, so memory use does not grow
+// with the number of iterations.
+//
+// Input is line oriented. A line is split at unquoted ';' into segments,
+// and then/do/else may be followed by a command on the same segment, so
+// both of these work:
+//
+//     if test -f x          for f in a b c; do gzip $f; done
+//     then
+//         cat x
+//     fi
+
+#define SEGMENTS_INITIAL 16
+
+typedef struct {
+    char** segments;
+    int count;
+    int pos;
+    int capacity;
+    int error;
+} parser;
+
+enum { LOOP_NONE, LOOP_BREAK, LOOP_CONTINUE };
+
+static int loop_depth = 0;
+static int loop_control = LOOP_NONE;
+
+// Returns what follows word at the start of s (past blanks), or NULL if s
+// does not start with that word
+static char* keyword_rest(char* s, const char* word) {
+    size_t len = strlen(word);
+    if (strncmp(s, word, len) != 0 || (s[len] != '\0' && s[len] != ' ' && s[len] != '\t')) {
+        return NULL;
+    }
+    s += len;
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+int is_compound_start(char* line) {
+    return keyword_rest(line, "if") != NULL || keyword_rest(line, "while") != NULL ||
+           keyword_rest(line, "for") != NULL;
+}
+
+// Input segments
+
+static void parser_push(parser* p, char* segment) {
+    if (p->count == p->capacity) {
+        int capacity = p->capacity ? p->capacity * 2 : SEGMENTS_INITIAL;
+        char** grown = arena_alloc(&command_arena, sizeof(char*) * capacity);
+        if (p->count > 0) {
+            memcpy(grown, p->segments, sizeof(char*) * p->count);
+        }
+        p->segments = grown;
+        p->capacity = capacity;
+    }
+    p->segments[p->count++] = segment;
+}
+
+// Split a line at ';' outside quotes and $(...) and queue the trimmed, non-empty segments
+static void parser_split(parser* p, const char* line) {
+    char* remaining = arena_strdup(&command_arena, line);
+    char* start;
+
+    while ((start = chain_next(&remaining)) != NULL) {
+        while (*start == ' ' || *start == '\t') start++;
+        char* end = start + strlen(start);
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+        *end = '\0';
+
+        if (*start != '\0' && *start != '#') {
+            // "then cmd", "do cmd" and "else cmd" are two segments
+            char* rest = NULL;
+            const char* keywords[] = {"then", "do", "else"};
+            for (int k = 0; k < 3 && rest == NULL; k++) {
+                rest = keyword_rest(start, keywords[k]);
+                if (rest != NULL && *rest != '\0') {
+                    rest[-1] = '\0';
+                    parser_push(p, start);
+                    parser_push(p, rest);
+                } else {
+                    rest = NULL;
+                }
+            }
+            if (rest == NULL) {
+                parser_push(p, start);
+            }
+        }
+    }
+}
+
+// Next segment, reading more input when the queue is empty
+static char* parser_next(parser* p, const char* prompt) {
+    while (p->pos == p->count) {
+        p->pos = p->count = 0;
+        char* line = read_input_line(prompt);
+        if (line == NULL) {
+            return NULL;
+        }
+        if (interactive && *line) {
+            add_history(line);
+        }
+        parser_split(p, line);
+        free(line);
+    }
+    return p->segments[p->pos++];
+}
+
+static node* node_new(node_type type) {
+    node* n = arena_alloc(&command_arena, sizeof(node));
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    return n;
+}
+
+static void parse_error(parser* p, const char* message, const char* detail) {
+    if (!p->error) {
+        fprintf(stderr, "Syntax error: %s%s%s\n", message, detail ? " " : "", detail ? detail : "");
+    }
+    p->error = 1;
+}
+
+// Parsing
+
+static node* parse_statement(parser* p, char* segment);
+
+static int is_terminator(char* segment, const char** terminators) {
+    for (int i = 0; terminators[i] != NULL; i++) {
+        if (keyword_rest(segment, terminators[i]) != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Statements up to one of the terminator keywords. The segment holding
+// the terminator is stored in *terminator.
+static node* parse_list(parser* p, const char* prompt, const char** terminators, char** terminator) {
+    node* head = NULL;
+    node** tail = &head;
+    *terminator = NULL;
+
+    while (!p->error) {
+        char* segment = parser_next(p, prompt);
+        if (segment == NULL) {
+            parse_error(p, "unexpected end of input, expected", terminators[0]);
+            break;
+        }
+        if (is_terminator(segment, terminators)) {
+            *terminator = segment;
+            break;
+        }
+        node* n = parse_statement(p, segment);
+        if (n != NULL) {
+            *tail = n;
+            tail = &n->next;
+        }
+    }
+    return head;
+}
+
+// Condition of if/elif/while: the rest of the keyword's segment, then
+// anything else up to the expected keyword
+static node* parse_condition(parser* p, char* first, const char* prompt, const char* keyword) {
+    const char* terminators[] = {keyword, NULL};
+    char* terminator;
+
+    node* cond = *first != '\0' ? parse_statement(p, first) : NULL;
+    node* more = parse_list(p, prompt, terminators, &terminator);
+    if (terminator != NULL && *keyword_rest(terminator, keyword) != '\0') {
+        parse_error(p, "unexpected text after", keyword);
+    }
+    if (cond == NULL) {
+        cond = more;
+    } else {
+        node* last = cond;
+        while (last->next != NULL) last = last->next;
+        last->next = more;
+    }
+    if (cond == NULL && !p->error) {
+        parse_error(p, "missing condition before", keyword);
+    }
+    return cond;
+}
+
+static node* parse_if(parser* p, char* condition) {
+    const char* branch_end[] = {"elif", "else", "fi", NULL};
+    const char* else_end[] = {"fi", NULL};
+    char* terminator;
+
+    node* n = node_new(NODE_IF);
+    n->cond = parse_condition(p, condition, "if> ", "then");
+    n->body = parse_list(p, "then> ", branch_end, &terminator);
+    if (p->error) {
+        return n;
+    }
+
+    char* rest;
+    if ((rest = keyword_rest(terminator, "elif")) != NULL) {
+        n->else_body = parse_if(p, rest);
+    } else if (keyword_rest(terminator, "else") != NULL) {
+        n->else_body = parse_list(p, "else> ", else_end, &terminator);
+        n->has_else = 1;
+    }
+    n->has_else |= n->else_body != NULL;
+    return n;
+}
+
+static int is_name(const char* s) {
+    if (!isalpha((unsigned char)*s) && *s != '_') {
+        return 0;
+    }
+    for (; *s; s++) {
+        if (!isalnum((unsigned char)*s) && *s != '_') return 0;
+    }
+    return 1;
+}
+
+static node* parse_for(parser* p, char* spec) {
+    node* n = node_new(NODE_FOR);
+    char** words = tokenize(spec);
+    if (words == NULL || !is_name(words[0])) {
+        parse_error(p, "bad for loop variable", words ? words[0] : NULL);
+        return n;
+    }
+    if (words[1] == NULL || strcmp(words[1], "in") != 0) {
+        parse_error(p, "expected 'in' after", words[0]);
+        return n;
+    }
+    n->text = words[0];
+    n->argv = words + 2;
+    for (n->argc = 0; n->argv[n->argc] != NULL; n->argc++);
+
+    // Nothing but "do" may follow the word list
+    const char* do_end[] = {"do", NULL};
+    const char* body_end[] = {"done", NULL};
+    char* terminator;
+    if (parse_list(p, "for> ", do_end, &terminator) != NULL && !p->error) {
+        parse_error(p, "expected", "do");
+    }
+    if (!p->error) {
+        n->body = parse_list(p, "do> ", body_end, &terminator);
+    }
+    return n;
+}
+
+static node* parse_statement(parser* p, char* segment) {
+    char* rest;
+    if ((rest = keyword_rest(segment, "if")) != NULL) {
+        return parse_if(p, rest);
+    }
+    if ((rest = keyword_rest(segment, "while")) != NULL) {
+        node* n = node_new(NODE_WHILE);
+        n->cond = parse_condition(p, rest, "while> ", "do");
+        if (p->error) return n;
+        const char* body_end[] = {"done", NULL};
+        char* terminator;
+        n->body = parse_list(p, "do> ", body_end, &terminator);
+        return n;
+    }
+    if ((rest = keyword_rest(segment, "for")) != NULL) {
+        return parse_for(p, rest);
+    }
+    if (strcmp(segment, "break") == 0) {
+        return node_new(NODE_BREAK);
+    }
+    if (strcmp(segment, "continue") == 0) {
+        return node_new(NODE_CONTINUE);
+    }
+
+    const char* stray[] = {"then", "elif", "else", "fi", "do", "done", NULL};
+    for (int i = 0; stray[i] != NULL; i++) {
+        if (keyword_rest(segment, stray[i]) != NULL) {
+            parse_error(p, "unexpected", stray[i]);
+            return NULL;
+        }
+    }
+    if ((rest = keyword_rest(segment, "parallel")) != NULL) {
+        if (strncmp(rest, "-j", 2) == 0) {
+            rest += 2;
+            while (*rest == ' ' || *rest == '\t') rest++;
+            while (isdigit((unsigned char)*rest)) rest++;
+            while (*rest == ' ' || *rest == '\t') rest++;
+        }
+        if (*rest == '\0') {
+            parse_error(p, "a parallel block cannot be nested; use 'parallel cmd; cmd'", NULL);
+            return NULL;
+        }
+    }
+
+    // Lines handled by the top-level dispatcher keep their text
+    const char* prefixes[] = {"time", "meter", "pipesize", "parallel", "pin", "nice", "cg", NULL};
+    for (int i = 0; prefixes[i] != NULL; i++) {
+        if (keyword_rest(segment, prefixes[i]) != NULL) {
+            node* n = node_new(NODE_LINE);
+            n->text = segment;
+            return n;
+        }
+    }
+
+    node* n = node_new(NODE_COMMAND);
+    n->argv = tokenize(segment);
+    if (n->argv == NULL) {
+        return NULL;
+    }
+    for (n->argc = 0; n->argv[n->argc] != NULL; n->argc++);
+    return n;
+}
+
+// Execution
+
+static void run_list(node* n, int (*dispatch)(char*));
+
+static void run_node(node* n, int (*dispatch)(char*)) {
+    arena_mark mark = arena_save(&command_arena);
+
+    switch (n->type) {
+        case NODE_COMMAND: {
+            char** argv = arena_alloc(&command_arena, sizeof(char*) * (n->argc + 1));
+            memcpy(argv, n->argv, sizeof(char*) * (n->argc + 1));
+            if (!handle_builtin(argv)) {
+                execute(argv);
+            }
+            break;
+        }
+        case NODE_LINE:
+            dispatch(arena_strdup(&command_arena, n->text));
+            break;
+        case NODE_IF:
+            run_list(n->cond, dispatch);
+            if (last_status == 0) {
+                run_list(n->body, dispatch);
+            } else if (n->has_else) {
+                last_status = 0;
+                run_list(n->else_body, dispatch);
+            } else {
+                last_status = 0;
+                if (interactive && loop_depth == 0) {
+                    printf("Condition failed, skipping then block\n");
+                }
+            }
+            break;
+        case NODE_WHILE: {
+            int status = 0;
+            loop_depth++;
+            while (loop_control != LOOP_BREAK) {
+                run_list(n->cond, dispatch);
+                if (last_status != 0) break;
+                last_status = 0;
+                run_list(n->body, dispatch);
+                status = last_status;
+                if (loop_control == LOOP_CONTINUE) loop_control = LOOP_NONE;
+            }
+            loop_control = LOOP_NONE;
+            loop_depth--;
+            last_status = status;
+            break;
+        }
+        case NODE_FOR: {
+            // Expand the word list once, before the first iteration
+            char** words = arena_alloc(&command_arena, sizeof(char*) * (n->argc + 1));
+            memcpy(words, n->argv, sizeof(char*) * (n->argc + 1));
+            expand_variables(words);
+
+            int status = 0;
+            size_t name_len = strlen(n->text);
+            loop_depth++;
+            for (int i = 0; words[i] != NULL && loop_control != LOOP_BREAK; i++) {
+                var_set(n->text, name_len, words[i], 0);
+                last_status = 0;
+                run_list(n->body, dispatch);
+                status = last_status;
+                if (loop_control == LOOP_CONTINUE) loop_control = LOOP_NONE;
+            }
+            loop_control = LOOP_NONE;
+            loop_depth--;
+            last_status = status;
+            break;
+        }
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+            if (loop_depth == 0) {
+                fprintf(stderr, "%s: only meaningful in a loop\n", n->type == NODE_BREAK ? "break" : "continue");
+                last_status = 1;
+            } else {
+                loop_control = n->type == NODE_BREAK ? LOOP_BREAK : LOOP_CONTINUE;
+                last_status = 0;
+            }
+            break;
+    }
+
+    arena_restore(&command_arena, mark);
+}
+
+static void run_list(node* n, int (*dispatch)(char*)) {
+    for (; n != NULL && loop_control == LOOP_NONE; n = n->next) {
+        run_node(n, dispatch);
+    }
+}
+
+// Parse a compound command starting with line, reading further lines as
+// needed, then run it. Segments left over on the last line read (as in
+// "for ...; done; echo finished") run after it. dispatch runs lines that
+// start with a dispatcher keyword such as time.
+int handle_compound(char* line, int (*dispatch)(char*)) {
+    parser p = {0};
+    parser_split(&p, line);
+
+    node* head = NULL;
+    node** tail = &head;
+    do {
+        node* n = parse_statement(&p, p.segments[p.pos++]);
+        if (n != NULL) {
+            *tail = n;
+            tail = &n->next;
+        }
+    } while (!p.error && p.pos < p.count);
+
+    if (p.error) {
+        last_status = 2;
+        return last_status;
+    }
+    last_status = 0;
+    run_list(head, dispatch);
+    return last_status;
+}
@@ -0,0 +1,206 @@
+#include "shell.h"
+
+// Cache of command name -> resolved executable path, so a launch does one
+// posix_spawn of a known path instead of execvp trying every PATH entry.
+// The table is an open-addressing hash keyed by command name. It is dropped
+// whenever PATH changes, and single entries are dropped when the binary they
+// point to disappears, or when the completion index sees a PATH directory
+// change under them.
+
+typedef struct {
+    char* name;
+    char* path;
+    unsigned long hits;
+} path_entry;
+
+int path_cache_enabled = 1;
+
+static path_entry* path_table = NULL;
+static int path_table_size = 0;
+static int path_table_count = 0;
+static char* path_table_var = NULL;
+
+// FNV-1a string hash
+unsigned int hash_bytes(const char* s, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+unsigned int hash_string(const char* s) {
+    return hash_bytes(s, strlen(s));
+}
+
+void path_cache_clear() {
+    for (int i = 0; i < path_table_size; i++) {
+        free(path_table[i].name);
+        free(path_table[i].path);
+    }
+    free(path_table);
+    path_table = NULL;
+    path_table_size = 0;
+    path_table_count = 0;
+}
+
+// Drop the cache if PATH has changed since it was filled
+static void path_cache_check_var() {
+    const char* current = getenv("PATH");
+    if (current == NULL) current = "";
+    if (path_table_var != NULL && strcmp(path_table_var, current) == 0) {
+        return;
+    }
+    path_cache_clear();
+    free(path_table_var);
+    path_table_var = strdup(current);
+}
+
+static path_entry* path_table_slot(const char* name) {
+    unsigned int mask = path_table_size - 1;
+    unsigned int i = hash_string(name) & mask;
+    while (path_table[i].name != NULL && strcmp(path_table[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &path_table[i];
+}
+
+static void path_table_grow() {
+    path_entry* old = path_table;
+    int old_size = path_table_size;
+
+    path_table_size = old_size ? old_size * 2 : 64;
+    path_table = calloc(path_table_size, sizeof(path_entry));
+    for (int i = 0; i < old_size; i++) {
+        if (old[i].name != NULL) {
+            *path_table_slot(old[i].name) = old[i];
+        }
+    }
+    free(old);
+}
+
+static path_entry* path_cache_insert(const char* name, const char* path) {
+    if ((path_table_count + 1) * 4 > path_table_size * 3) {
+        path_table_grow();
+    }
+    path_entry* entry = path_table_slot(name);
+    if (entry->name == NULL) {
+        entry->name = strdup(name);
+        entry->hits = 0;
+        path_table_count++;
+    } else {
+        free(entry->path);
+    }
+    entry->path = strdup(path);
+    return entry;
+}
+
+// Walk PATH the way execvp would. A stat miss costs one syscall per entry.
+static char* path_search(const char* name, char* buf, size_t size) {
+    const char* dir = path_table_var;
+    while (1) {
+        const char* end = strchr(dir, ':');
+        int dir_len = end ? (int)(end - dir) : (int)strlen(dir);
+
+        if (dir_len == 0) {
+            snprintf(buf, size, "%s", name);
+        } else {
+            snprintf(buf, size, "%.*s/%s", dir_len, dir, name);
+        }
+
+        struct stat st;
+        if (stat(buf, &st) == 0 && S_ISREG(st.st_mode) && access(buf, X_OK) == 0) {
+            return buf;
+        }
+        if (end == NULL) {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+// Resolve a command name to the path it would be executed from. Names that
+// contain a slash are returned unchanged. Returns NULL if the command is not
+// found on PATH.
+const char* path_lookup(const char* name) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    path_cache_check_var();
+
+    if (path_table_size > 0) {
+        path_entry* entry = path_table_slot(name);
+        if (entry->name != NULL && entry->path != NULL) {
+            entry->hits++;
+            return entry->path;
+        }
+    }
+
+    // The completion index, once built, knows where every command is
+    char buf[MAX_LEN];
+    if (path_index_lookup(name, buf, sizeof(buf)) == NULL && path_search(name, buf, sizeof(buf)) == NULL) {
+        return NULL;
+    }
+    path_entry* entry = path_cache_insert(name, buf);
+    entry->hits++;
+    return entry->path;
+}
+
+// Forget a single command, e.g. after its binary was removed
+void path_cache_invalidate(const char* name) {
+    if (path_table_size == 0) {
+        return;
+    }
+    path_entry* entry = path_table_slot(name);
+    if (entry->name != NULL) {
+        free(entry->path);
+        entry->path = NULL;
+    }
+}
+
+// hash [-r] [-p path name] [name...]
+int handle_hash(char** arglist) {
+    path_cache_check_var();
+
+    if (arglist[1] == NULL) {
+        if (path_table_count == 0) {
+            printf("hash: hash table empty\n");
+            return 0;
+        }
+        printf("hits\tcommand\n");
+        for (int i = 0; i < path_table_size; i++) {
+            if (path_table[i].name != NULL && path_table[i].path != NULL) {
+                printf("%4lu\t%s\n", path_table[i].hits, path_table[i].path);
+            }
+        }
+        return 0;
+    }
+
+    if (strcmp(arglist[1], "-r") == 0) {
+        path_cache_clear();
+        return 0;
+    }
+
+    if (strcmp(arglist[1], "-p") == 0) {
+        if (arglist[2] == NULL || arglist[3] == NULL) {
+            fprintf(stderr, "hash: usage: hash -p path name\n");
+            return 1;
+        }
+        path_cache_insert(arglist[3], arglist[2]);
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; arglist[i] != NULL; i++) {
+        if (path_lookup(arglist[i]) == NULL) {
+            fprintf(stderr, "hash: %s: not found\n", arglist[i]);
+            status = 1;
+        } else if (strchr(arglist[i], '/') == NULL) {
+            // Resolving is not a use of the command
+            path_table_slot(arglist[i])->hits--;
+        }
+    }
+    return status;
+}
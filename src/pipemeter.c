@@ -0,0 +1,234 @@
+#include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+
+// Pipe capacity and pipeline metering.
+//
+// Pipes are created with the capacity given by `pipesize SIZE` in front of
+// the pipeline or by MYSHELL_PIPESIZE (bytes, K or M suffix), via
+// F_SETPIPE_SZ. Bigger pipes let stages run longer between context switches.
+//
+// With `meter` in front of the pipeline, or MYSHELL_PIPEMETER set, every
+// stage boundary is split into two pipes and the shell relays the data
+// between them with non-blocking splice. For each boundary it counts the
+// bytes and the time the relay spent waiting for the upstream stage
+// (starved) or for the downstream stage (blocked), and reports both per
+// stage when the pipeline ends.
+
+#define RELAY_CHUNK (1 << 20)
+
+long pipe_size_override = 0;
+int pipe_meter_override = 0;
+
+// Parse "65536", "256K" or "1M"; returns 0 if size is not valid
+long parse_size(const char* size) {
+    char* end;
+    long value = strtol(size, &end, 10);
+    if (end == size || value <= 0) {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K') {
+        value <<= 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        value <<= 20;
+        end++;
+    }
+    return *end == '\0' ? value : 0;
+}
+
+static long pipe_capacity() {
+    if (pipe_size_override > 0) {
+        return pipe_size_override;
+    }
+    const char* size = var_get("MYSHELL_PIPESIZE");
+    return size != NULL ? parse_size(size) : 0;
+}
+
+int pipe_metering() {
+    if (pipe_meter_override) {
+        return 1;
+    }
+    const char* meter = var_get("MYSHELL_PIPEMETER");
+    return meter != NULL && *meter != '\0' && strcmp(meter, "0") != 0;
+}
+
+// pipe2(O_CLOEXEC) with the configured capacity. A capacity the kernel
+// refuses (above /proc/sys/fs/pipe-max-size without privileges) is reported
+// once per shell and otherwise ignored.
+int pipe_open(int fds[2]) {
+    static int size_warned = 0;
+
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    long size = pipe_capacity();
+    if (size > 0 && fcntl(fds[1], F_SETPIPE_SZ, (int)size) == -1 && !size_warned) {
+        fprintf(stderr, "pipe size %ld: %s\n", size, strerror(errno));
+        size_warned = 1;
+    }
+    return 0;
+}
+
+// Metering relay
+
+enum { RELAY_MOVING, RELAY_STARVED, RELAY_BLOCKED };
+
+typedef struct {
+    int in;
+    int out;
+    int state;
+    int done;
+    long long bytes;
+    double starved;
+    double blocked;
+} relay;
+
+struct pipe_meter {
+    relay* relays;
+    int count;
+    double start;
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void relay_finish(relay* r) {
+    close(r->in);
+    close(r->out);
+    r->done = 1;
+}
+
+// Move whatever one boundary can move right now. Returns 1 if data moved.
+static int relay_step(relay* r) {
+    ssize_t n = splice(r->in, NULL, r->out, NULL, RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+        r->bytes += n;
+        r->state = RELAY_MOVING;
+        return 1;
+    }
+    if (n == 0) {
+        // Upstream finished: pass end of file on
+        relay_finish(r);
+        return 0;
+    }
+    if (errno == EINTR) {
+        return 0;
+    }
+    if (errno == EAGAIN) {
+        struct pollfd in = {r->in, POLLIN, 0};
+        r->state = poll(&in, 1, 0) > 0 && (in.revents & POLLIN) ? RELAY_BLOCKED : RELAY_STARVED;
+        return 0;
+    }
+    // EPIPE: downstream exited; closing our end lets upstream see it too
+    if (errno != EPIPE) {
+        perror("pipe meter");
+    }
+    relay_finish(r);
+    return 0;
+}
+
+// Print bytes, throughput and stall times per stage. The stage that waited
+// least is the one the others were waiting for.
+void pipe_meter_report(pipe_meter* meter, char*** stages) {
+    int stage_count = meter->count + 1;
+    relay* relays = meter->relays;
+    double elapsed = now_sec() - meter->start;
+    int bottleneck = 0;
+    double least_wait = -1;
+    for (int i = 0; i < stage_count; i++) {
+        double wait = (i > 0 ? relays[i - 1].starved : 0) + (i < stage_count - 1 ? relays[i].blocked : 0);
+        if (least_wait < 0 || wait < least_wait) {
+            least_wait = wait;
+            bottleneck = i;
+        }
+    }
+
+    fprintf(stderr, "pipeline %.3fs\n", elapsed);
+    fprintf(stderr, "%-6s %-12s %14s %10s %9s %9s\n", "stage", "command", "bytes_out", "MB/s_out",
+            "wait_in", "wait_out");
+    for (int i = 0; i < stage_count; i++) {
+        char bytes[32] = "-";
+        char rate[32] = "-";
+        char wait_in[32] = "-";
+        char wait_out[32] = "-";
+        if (i < stage_count - 1) {
+            snprintf(bytes, sizeof(bytes), "%lld", relays[i].bytes);
+            snprintf(rate, sizeof(rate), "%.1f", elapsed > 0 ? relays[i].bytes / elapsed / (1 << 20) : 0);
+            snprintf(wait_out, sizeof(wait_out), "%.3fs", relays[i].blocked);
+        }
+        if (i > 0) {
+            snprintf(wait_in, sizeof(wait_in), "%.3fs", relays[i - 1].starved);
+        }
+        fprintf(stderr, "%-6d %-12s %14s %10s %9s %9s%s\n", i + 1, stages[i][0], bytes, rate,
+                wait_in, wait_out, i == bottleneck ? "  <- bottleneck" : "");
+    }
+}
+
+// Relay every boundary until all of them reach end of file. relay_in[i] is
+// the read end of stage i's output pipe, relay_out[i] the write end of stage
+// i+1's input pipe; all of them are closed here.
+pipe_meter* pipe_meter_relay(int stage_count, int* relay_in, int* relay_out) {
+    int count = stage_count - 1;
+    pipe_meter* meter = arena_alloc(&command_arena, sizeof(pipe_meter));
+    relay* relays = arena_alloc(&command_arena, sizeof(relay) * count);
+    struct pollfd* fds = arena_alloc(&command_arena, sizeof(struct pollfd) * count);
+    for (int i = 0; i < count; i++) {
+        memset(&relays[i], 0, sizeof(relay));
+        relays[i].in = relay_in[i];
+        relays[i].out = relay_out[i];
+        relays[i].state = RELAY_STARVED;
+    }
+    meter->relays = relays;
+    meter->count = count;
+    meter->start = now_sec();
+
+    // A stage that exits early must not take the shell with it
+    struct sigaction ignore, saved;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &saved);
+
+    double last = meter->start;
+    int active = count;
+    while (active > 0) {
+        int moved = 0;
+        for (int i = 0; i < count; i++) {
+            if (!relays[i].done) {
+                moved |= relay_step(&relays[i]);
+            }
+        }
+
+        // Sleep until some boundary can make progress
+        int nfds = 0;
+        for (int i = 0; i < count; i++) {
+            if (relays[i].done) continue;
+            fds[nfds].fd = relays[i].state == RELAY_BLOCKED ? relays[i].out : relays[i].in;
+            fds[nfds].events = relays[i].state == RELAY_BLOCKED ? POLLOUT : POLLIN;
+            nfds++;
+        }
+        active = nfds;
+        if (nfds > 0 && !moved) {
+            poll(fds, nfds, -1);
+        }
+
+        // Charge the time since the last pass to each boundary's state
+        double now = now_sec();
+        for (int i = 0; i < count; i++) {
+            if (relays[i].done) continue;
+            if (relays[i].state == RELAY_STARVED) {
+                relays[i].starved += now - last;
+            } else if (relays[i].state == RELAY_BLOCKED) {
+                relays[i].blocked += now - last;
+            }
+        }
+        last = now;
+    }
+
+    sigaction(SIGPIPE, &saved, NULL);
+    return meter;
+}
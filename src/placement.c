@@ -0,0 +1,178 @@
+#include "shell.h"
+#include <errno.h>
+#include <sched.h>
+
+// Job placement: the CPUs, niceness and cgroup a command runs with.
+//
+//     pin 0-3,8 CMDLINE       pin node:1 CMDLINE
+//     nice [-n N | -N] CMDLINE
+//     cg batch/low CMDLINE    (relative to /sys/fs/cgroup, or absolute)
+//
+// Prefixes nest and apply to every process the rest of the line starts:
+// each pipeline stage, each background job. The child applies them to
+// itself between fork and exec - cgroup first, then affinity, then
+// niceness - so the program starts already placed. Commands that would
+// normally run inside the shell (cat, echo, test...) are forked instead
+// while a placement is in effect.
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#define NICE_DEFAULT 10
+
+placement job_placement = {0};
+
+int placement_active() {
+    return job_placement.has_cpus || job_placement.nice != 0 || job_placement.cgroup[0] != '\0';
+}
+
+// Parse a CPU list ("0-3,8,10-11") or "node:N" into set. Returns -1 after
+// reporting an invalid spec.
+int placement_parse_cpus(const char* spec, cpu_set_t* set) {
+    char list[256];
+    const char* cpus = spec;
+
+    if (strncmp(spec, "node:", 5) == 0) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%s/cpulist", spec + 5);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        ssize_t n = fd == -1 ? -1 : read(fd, list, sizeof(list) - 1);
+        if (fd != -1) close(fd);
+        if (n <= 0) {
+            fprintf(stderr, "pin: %s: no such NUMA node\n", spec);
+            return -1;
+        }
+        list[n] = '\0';
+        list[strcspn(list, "\n")] = '\0';
+        cpus = list;
+    }
+
+    CPU_ZERO(set);
+    const char* p = cpus;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) break;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) break;
+        }
+        if (last >= CPU_SETSIZE) break;
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        p = end;
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            break;
+        }
+    }
+    if (*p != '\0' || CPU_COUNT(set) == 0) {
+        fprintf(stderr, "pin: %s: invalid CPU list\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+// pin SPEC: restrict to the given CPUs
+int placement_set_cpus(const char* spec) {
+    cpu_set_t set;
+    if (placement_parse_cpus(spec, &set) == -1) {
+        return -1;
+    }
+    job_placement.cpus = set;
+    job_placement.has_cpus = 1;
+    snprintf(job_placement.cpus_text, sizeof(job_placement.cpus_text), "%s", spec);
+    return 0;
+}
+
+// nice [-n N | -N]: *line is moved past the option, if any
+int placement_set_nice(char** line) {
+    int increment = NICE_DEFAULT;
+    char* p = *line;
+    char* number = NULL;
+
+    if (strncmp(p, "-n", 2) == 0 && (p[2] == ' ' || p[2] == '\t')) {
+        number = p + 3;
+        while (*number == ' ' || *number == '\t') number++;
+    } else if (p[0] == '-' && (isdigit((unsigned char)p[1]) || p[1] == '-')) {
+        number = p + 1;
+    }
+    if (number != NULL) {
+        char* end;
+        increment = strtol(number, &end, 10);
+        if (end == number || (*end != '\0' && *end != ' ' && *end != '\t')) {
+            fprintf(stderr, "nice: invalid adjustment\n");
+            return -1;
+        }
+        while (*end == ' ' || *end == '\t') end++;
+        *line = end;
+    }
+    job_placement.nice += increment;
+    return 0;
+}
+
+// cg PATH: run in the cgroup-v2 directory PATH
+int placement_set_cgroup(const char* path) {
+    char dir[sizeof(job_placement.cgroup)];
+    snprintf(dir, sizeof(dir), path[0] == '/' ? "%s" : CGROUP_ROOT "/%s", path);
+
+    char procs[sizeof(dir) + 16];
+    snprintf(procs, sizeof(procs), "%s/cgroup.procs", dir);
+    if (access(procs, W_OK) != 0) {
+        fprintf(stderr, "cg: %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    memcpy(job_placement.cgroup, dir, sizeof(dir));
+    return 0;
+}
+
+// Place the calling process (a child about to exec). Returns -1 after
+// reporting the first failure.
+int placement_apply() {
+    if (job_placement.cgroup[0] != '\0') {
+        char procs[sizeof(job_placement.cgroup) + 16];
+        snprintf(procs, sizeof(procs), "%s/cgroup.procs", job_placement.cgroup);
+        int fd = open(procs, O_WRONLY | O_CLOEXEC);
+        if (fd == -1 || write(fd, "0", 1) != 1) {
+            fprintf(stderr, "cg: %s: %s\n", job_placement.cgroup, strerror(errno));
+            if (fd != -1) close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    if (job_placement.has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &job_placement.cpus) == -1) {
+        fprintf(stderr, "pin: %s: %s\n", job_placement.cpus_text, strerror(errno));
+        return -1;
+    }
+    if (job_placement.nice != 0) {
+        errno = 0;
+        if (nice(job_placement.nice) == -1 && errno != 0) {
+            fprintf(stderr, "nice: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// "cpus=0-3 nice=10 cg=/sys/fs/cgroup/batch" for the current placement,
+// malloc'd, or NULL if there is none
+char* placement_describe() {
+    if (!placement_active()) {
+        return NULL;
+    }
+    char text[MAX_LEN];
+    int len = 0;
+    if (job_placement.has_cpus) {
+        len += snprintf(text + len, sizeof(text) - len, "cpus=%s ", job_placement.cpus_text);
+    }
+    if (job_placement.nice != 0) {
+        len += snprintf(text + len, sizeof(text) - len, "nice=%d ", job_placement.nice);
+    }
+    if (job_placement.cgroup[0] != '\0') {
+        len += snprintf(text + len, sizeof(text) - len, "cg=%s ", job_placement.cgroup);
+    }
+    text[len - 1] = '\0';
+    return strdup(text);
+}
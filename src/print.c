@@ -0,0 +1,300 @@
+#include "shell.h"
+#include <errno.h>
+#include <signal.h>
+
+// echo, printf, true, false and : as stream builtins. Output is formatted
+// into one buffer and written with a single write, so a short echo costs
+// one system call and no process.
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} out_buffer;
+
+static void out_reserve(out_buffer* out, size_t extra) {
+    if (out->len + extra <= out->capacity) {
+        return;
+    }
+    size_t capacity = out->capacity ? out->capacity : 256;
+    while (capacity < out->len + extra) capacity *= 2;
+    char* data = realloc(out->data, capacity);
+    if (data == NULL) {
+        perror("realloc failed");
+        exit(1);
+    }
+    out->data = data;
+    out->capacity = capacity;
+}
+
+static void out_append(out_buffer* out, const char* s, size_t len) {
+    out_reserve(out, len);
+    memcpy(out->data + out->len, s, len);
+    out->len += len;
+}
+
+static void out_char(out_buffer* out, char c) {
+    out_append(out, &c, 1);
+}
+
+// Write the buffer out and free it; returns the builtin's exit status
+static int out_flush(const char* name, out_buffer* out, stdio_fds* io, int status) {
+    const char* p = out->data;
+    size_t left = out->len;
+    while (left > 0) {
+        ssize_t n = write(io->fd[STDOUT_FILENO], p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EPIPE) {
+                status = 128 + SIGPIPE;
+            } else {
+                dprintf(io->fd[STDERR_FILENO], "%s: write error: %s\n", name, strerror(errno));
+                status = 1;
+            }
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    free(out->data);
+    return status;
+}
+
+// Append s with backslash escapes interpreted. Returns 1 if \c asked for
+// all further output to be suppressed.
+static int out_escaped(out_buffer* out, const char* s, size_t len) {
+    const char* end = s + len;
+    while (s < end) {
+        if (*s != '\\' || s + 1 == end) {
+            out_char(out, *s++);
+            continue;
+        }
+        s++;
+        char c = *s++;
+        switch (c) {
+            case 'a': out_char(out, '\a'); break;
+            case 'b': out_char(out, '\b'); break;
+            case 'e': out_char(out, 27); break;
+            case 'f': out_char(out, '\f'); break;
+            case 'n': out_char(out, '\n'); break;
+            case 'r': out_char(out, '\r'); break;
+            case 't': out_char(out, '\t'); break;
+            case 'v': out_char(out, '\v'); break;
+            case '\\': out_char(out, '\\'); break;
+            case 'c': return 1;
+            case '0': {
+                // \0nnn: up to three octal digits
+                int value = 0;
+                for (int i = 0; i < 3 && s < end && *s >= '0' && *s <= '7'; i++) {
+                    value = value * 8 + (*s++ - '0');
+                }
+                out_char(out, (char)value);
+                break;
+            }
+            default:
+                out_char(out, '\\');
+                out_char(out, c);
+                break;
+        }
+    }
+    return 0;
+}
+
+// echo [-neE] [arg...]
+int builtin_echo(char** argv, stdio_fds* io) {
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+
+    // Only words made entirely of option letters are options
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) {
+            break;
+        }
+        for (const char* c = argv[i] + 1; *c; c++) {
+            if (*c == 'n') newline = 0;
+            else if (*c == 'e') escapes = 1;
+            else escapes = 0;
+        }
+    }
+
+    out_buffer out = {0};
+    int stop = 0;
+    for (int first = i; argv[i] != NULL && !stop; i++) {
+        if (i > first) {
+            out_char(&out, ' ');
+        }
+        if (escapes) {
+            stop = out_escaped(&out, argv[i], strlen(argv[i]));
+        } else {
+            out_append(&out, argv[i], strlen(argv[i]));
+        }
+    }
+    if (newline && !stop) {
+        out_char(&out, '\n');
+    }
+    return out_flush("echo", &out, io, 0);
+}
+
+// Numeric printf argument; a leading quote gives the character's code
+static int printf_number(const char* arg, long long* value, stdio_fds* io) {
+    if (arg[0] == '\'' || arg[0] == '"') {
+        *value = (unsigned char)arg[1];
+        return 0;
+    }
+    char* end;
+    errno = 0;
+    *value = strtoll(arg, &end, 0);
+    if (end == arg || *end != '\0' || errno != 0) {
+        dprintf(io->fd[STDERR_FILENO], "printf: %s: invalid number\n", arg);
+        return 1;
+    }
+    return 0;
+}
+
+// One pass over the format. Consumes arguments from *args; returns 1 in
+// *stop if \c ended the output.
+static int printf_format(out_buffer* out, const char* format, char*** args, int* stop, stdio_fds* io) {
+    int status = 0;
+    for (const char* f = format; *f && !*stop; f++) {
+        if (*f == '\\') {
+            // One escape at a time, so \c can stop the output
+            size_t len = f[1] == '\0' ? 1 : 2;
+            if (f[1] == '0') {
+                while (len < 5 && f[len] >= '0' && f[len] <= '7') len++;
+            }
+            *stop = out_escaped(out, f, len);
+            f += len - 1;
+            continue;
+        }
+        if (*f != '%') {
+            out_char(out, *f);
+            continue;
+        }
+        if (f[1] == '%') {
+            out_char(out, '%');
+            f++;
+            continue;
+        }
+
+        // %[flags][width][.precision]conversion
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = *f++;
+        while (*f && strchr("-+ #0", *f) && n < 32) spec[n++] = *f++;
+        while (isdigit((unsigned char)*f) && n < 40) spec[n++] = *f++;
+        if (*f == '.') {
+            spec[n++] = *f++;
+            while (isdigit((unsigned char)*f) && n < 48) spec[n++] = *f++;
+        }
+        char conversion = *f;
+        if (conversion == '\0') {
+            dprintf(io->fd[STDERR_FILENO], "printf: missing conversion in format\n");
+            return 1;
+        }
+
+        const char* arg = **args != NULL ? *(*args)++ : NULL;
+        char buf[512];
+        int len;
+        switch (conversion) {
+            case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c': {
+                long long value = 0;
+                if (conversion == 'c') {
+                    value = arg != NULL ? (unsigned char)arg[0] : 0;
+                } else if (arg != NULL && printf_number(arg, &value, io) != 0) {
+                    status = 1;
+                }
+                if (conversion != 'c') {
+                    spec[n++] = 'l';
+                    spec[n++] = 'l';
+                }
+                spec[n++] = conversion;
+                spec[n] = '\0';
+                len = conversion == 'c' ? snprintf(buf, sizeof(buf), spec, (int)value)
+                                        : snprintf(buf, sizeof(buf), spec, value);
+                if (conversion == 'c' && value == 0) {
+                    break;
+                }
+                out_append(out, buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                double value = 0;
+                if (arg != NULL) {
+                    char* end;
+                    value = strtod(arg, &end);
+                    if (end == arg || *end != '\0') {
+                        dprintf(io->fd[STDERR_FILENO], "printf: %s: invalid number\n", arg);
+                        status = 1;
+                    }
+                }
+                spec[n++] = conversion;
+                spec[n] = '\0';
+                len = snprintf(buf, sizeof(buf), spec, value);
+                out_append(out, buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+                break;
+            }
+            case 's':
+            case 'b': {
+                const char* s = arg != NULL ? arg : "";
+                if (conversion == 'b') {
+                    out_buffer expanded = {0};
+                    *stop = out_escaped(&expanded, s, strlen(s));
+                    out_char(&expanded, '\0');
+                    s = arena_strdup(&command_arena, expanded.data);
+                    free(expanded.data);
+                }
+                if (n == 1) {
+                    out_append(out, s, strlen(s));
+                    break;
+                }
+                spec[n++] = 's';
+                spec[n] = '\0';
+                int needed = snprintf(NULL, 0, spec, s);
+                out_reserve(out, needed + 1);
+                snprintf(out->data + out->len, needed + 1, spec, s);
+                out->len += needed;
+                break;
+            }
+            default:
+                dprintf(io->fd[STDERR_FILENO], "printf: %%%c: invalid conversion\n", conversion);
+                return 1;
+        }
+    }
+    return status;
+}
+
+// printf format [arg...]. The format is reused until the arguments run out.
+int builtin_printf(char** argv, stdio_fds* io) {
+    int i = 1;
+    if (argv[i] != NULL && strcmp(argv[i], "--") == 0) i++;
+    if (argv[i] == NULL) {
+        dprintf(io->fd[STDERR_FILENO], "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    const char* format = argv[i];
+    char** args = &argv[i + 1];
+    out_buffer out = {0};
+    int status = 0;
+    int stop = 0;
+    do {
+        char** before = args;
+        status |= printf_format(&out, format, &args, &stop, io);
+        if (args == before) break;  // the format takes no arguments
+    } while (*args != NULL && !stop);
+
+    return out_flush("printf", &out, io, status);
+}
+
+int builtin_true(char** argv, stdio_fds* io) {
+    (void)argv;
+    (void)io;
+    return 0;
+}
+
+int builtin_false(char** argv, stdio_fds* io) {
+    (void)argv;
+    (void)io;
+    return 1;
+}
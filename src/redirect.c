@@ -0,0 +1,325 @@
+#include "shell.h"
+#include <errno.h>
+#include <sys/mman.h>
+
+// Redirections.
+//
+//     < file    > file    >> file     N< file   N> file   N>> file
+//     N>&M      N<&M      N>&-        <<WORD    <<<word
+//
+// The tokenizer keeps each operator, with its descriptor number and any &M,
+// in one token. redirection_actions() turns them into spawn file actions, so
+// a redirection is applied the same way whether the command is launched,
+// forked or run as a stream builtin, and in the order it was written:
+// "> out 2>&1" sends both streams to out, "2>&1 > out" only stdout.
+//
+// Here-document and here-string bodies never touch the filesystem. A body
+// that fits in a pipe is written into one up front; a bigger one goes into a
+// memfd. Either way the command reads it from its stdin (or fd N).
+//
+// A here-document body is expanded like a word ($VAR, $(...)) when the
+// command runs, unless its delimiter was quoted: <<"EOF" or <<'EOF'. The
+// tokenizer records a quoted delimiter by writing the operator as <<' (or
+// N<<'), a token no input can produce since ' ends an operator.
+//
+// N>&M and N<&M only accept an M of 0 to 2, one this command's earlier
+// redirections set up, or one the shell inherited. The shell's own
+// descriptors (history, trace, event loop...) are all close-on-exec, and
+// are refused as if they were not open.
+
+#define HEREDOC_PIPE_MAX 65536
+#define HEREDOC_PROMPT "> "
+
+typedef struct {
+    int kind;
+    int fd;       // descriptor being redirected
+    int src_fd;   // M in N>&M
+} redirection;
+
+// Length of the redirection operator at the start of s, or 0 if there is none
+size_t redirection_length(const char* s) {
+    const char* p = s;
+    while (isdigit((unsigned char)*p)) p++;
+
+    if (*p == '<') {
+        p++;
+        if (*p == '<') {
+            p++;
+            if (*p == '<') p++;
+            return p - s;
+        }
+    } else if (*p == '>') {
+        p++;
+        if (*p == '>') {
+            return p + 1 - s;
+        }
+    } else {
+        return 0;
+    }
+
+    // < or >, optionally followed by &M or &-
+    if (*p == '&') {
+        if (p[1] == '-') {
+            return p + 2 - s;
+        }
+        const char* digits = p + 1;
+        while (isdigit((unsigned char)*digits)) digits++;
+        if (digits > p + 1) {
+            return digits - s;
+        }
+    }
+    return p - s;
+}
+
+static int redirection_parse(const char* token, redirection* r) {
+    size_t len = redirection_length(token);
+    int literal = len >= 2 && token[len - 1] == '<' && token[len - 2] == '<' && token[len] == '\'' &&
+                  token[len + 1] == '\0';
+    if (len == 0 || (token[len] != '\0' && !literal)) {
+        return 0;
+    }
+
+    const char* op = token;
+    while (isdigit((unsigned char)*op)) op++;
+    int fd = op > token ? atoi(token) : (*op == '<' ? STDIN_FILENO : STDOUT_FILENO);
+
+    r->fd = fd;
+    r->src_fd = -1;
+    if (strcmp(op, "<<<") == 0) {
+        r->kind = REDIR_HERESTRING;
+    } else if (strcmp(op, "<<") == 0) {
+        r->kind = REDIR_HEREDOC;
+    } else if (strcmp(op, "<<'") == 0) {
+        r->kind = REDIR_HEREDOC_LITERAL;
+    } else if (strcmp(op, ">>") == 0) {
+        r->kind = REDIR_APPEND;
+    } else if (strcmp(op, "<") == 0) {
+        r->kind = REDIR_IN;
+    } else if (strcmp(op, ">") == 0) {
+        r->kind = REDIR_OUT;
+    } else if (op[2] == '-') {
+        r->kind = REDIR_CLOSE;
+    } else {
+        r->kind = REDIR_DUP;
+        r->src_fd = atoi(op + 2);
+    }
+    return 1;
+}
+
+// REDIR_NONE if token is not a redirection operator
+int redirection_kind(const char* token) {
+    redirection r;
+    return redirection_parse(token, &r) ? r.kind : REDIR_NONE;
+}
+
+// Read here-document lines up to one that is exactly delimiter. The body
+// is kept in command_arena with a newline after every line.
+static char* heredoc_read(const char* delimiter) {
+    size_t size = 0;
+    size_t capacity = 256;
+    char* body = malloc(capacity);
+    if (body == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+
+    char* line;
+    while ((line = read_input_line(HEREDOC_PROMPT)) != NULL && strcmp(line, delimiter) != 0) {
+        size_t len = strlen(line);
+        while (size + len + 2 > capacity) {
+            capacity *= 2;
+            body = realloc(body, capacity);
+            if (body == NULL) {
+                perror("realloc failed");
+                exit(1);
+            }
+        }
+        memcpy(body + size, line, len);
+        size += len;
+        body[size++] = '\n';
+        free(line);
+    }
+    if (line == NULL) {
+        fprintf(stderr, "warning: here-document ended by end of file (wanted '%s')\n", delimiter);
+    }
+    free(line);
+
+    char* kept = arena_strndup(&command_arena, body, size);
+    free(body);
+    return kept;
+}
+
+// The operator for a here-document whose delimiter was quoted
+char* heredoc_literal(const char* op) {
+    size_t len = strlen(op);
+    char* marked = arena_alloc(&command_arena, len + 2);
+    memcpy(marked, op, len);
+    marked[len] = '\'';
+    marked[len + 1] = '\0';
+    return marked;
+}
+
+// Replace the word after each << with the here-document it introduces.
+// Called by tokenize(), so the body is read right after its command line.
+// The tokenizer leaves ' alone, so a delimiter in single quotes is
+// unquoted here.
+void heredoc_collect(char** arglist) {
+    for (int i = 0; arglist[i] != NULL; i++) {
+        int kind = redirection_kind(arglist[i]);
+        if (arglist[i + 1] == NULL || (kind != REDIR_HEREDOC && kind != REDIR_HEREDOC_LITERAL)) {
+            continue;
+        }
+        char* delimiter = arglist[i + 1];
+        size_t len = strlen(delimiter);
+        if (len >= 2 && delimiter[0] == '\'' && delimiter[len - 1] == '\'') {
+            delimiter = arena_strndup(&command_arena, delimiter + 1, len - 2);
+            if (kind == REDIR_HEREDOC) {
+                arglist[i] = heredoc_literal(arglist[i]);
+            }
+        }
+        arglist[i + 1] = heredoc_read(delimiter);
+        i++;
+    }
+}
+
+// Whether M in N>&M may be used: see the top of the file. opened holds the
+// descriptors the command's earlier redirections set up.
+static int redirection_source_ok(int src_fd, const int* opened, int count) {
+    if (src_fd <= STDERR_FILENO) {
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (opened[i] == src_fd) {
+            return 1;
+        }
+    }
+    int flags = fcntl(src_fd, F_GETFD);
+    return flags != -1 && !(flags & FD_CLOEXEC);
+}
+
+static void opened_remove(int* opened, int* count, int fd) {
+    for (int i = 0; i < *count; i++) {
+        if (opened[i] == fd) {
+            opened[i--] = opened[--*count];
+        }
+    }
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// A close-on-exec descriptor to read body from: a pipe already holding
+// it when it fits, otherwise a memfd positioned at the start
+static int body_fd(const char* body, size_t len) {
+    int fds[2];
+    if (len <= HEREDOC_PIPE_MAX && pipe2(fds, O_CLOEXEC) == 0) {
+        int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+        if (capacity >= 0 && len <= (size_t)capacity && write_all(fds[1], body, len) == 0) {
+            close(fds[1]);
+            return fds[0];
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+    if (fd == -1) {
+        perror("memfd_create failed");
+        return -1;
+    }
+    if (write_all(fd, body, len) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+        perror("here-document");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Turn the redirections in arglist into spawn file actions, removing them
+// (and their words) from arglist. Returns -1 after reporting an error.
+int redirection_actions(char** arglist, spawn_actions* actions) {
+    int status = 0;
+    int kept = 0;
+    int words = 0;
+    while (arglist[words] != NULL) words++;
+    int* opened = arena_alloc(&command_arena, sizeof(int) * (words + 1));
+    int opened_count = 0;
+
+    for (int i = 0; arglist[i] != NULL; i++) {
+        redirection r;
+        if (!redirection_parse(arglist[i], &r)) {
+            arglist[kept++] = arglist[i];
+            continue;
+        }
+        if (r.kind == REDIR_DUP) {
+            if (!redirection_source_ok(r.src_fd, opened, opened_count)) {
+                fprintf(stderr, "%d: Bad file descriptor\n", r.src_fd);
+                status = -1;
+                break;
+            }
+            spawn_add_dup2(actions, r.src_fd, r.fd);
+            opened_remove(opened, &opened_count, r.fd);
+            opened[opened_count++] = r.fd;
+            continue;
+        }
+        if (r.kind == REDIR_CLOSE) {
+            spawn_add_close(actions, r.fd);
+            opened_remove(opened, &opened_count, r.fd);
+            continue;
+        }
+
+        char* word = arglist[i + 1];
+        if (word == NULL) {
+            fprintf(stderr, "Syntax error: missing word after %s\n", arglist[i]);
+            status = -1;
+            break;
+        }
+        i++;
+
+        switch (r.kind) {
+            case REDIR_IN:
+                spawn_add_open(actions, r.fd, word, O_RDONLY, 0);
+                break;
+            case REDIR_OUT:
+                spawn_add_open(actions, r.fd, word, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                break;
+            case REDIR_APPEND:
+                spawn_add_open(actions, r.fd, word, O_WRONLY | O_CREAT | O_APPEND, 0644);
+                break;
+            case REDIR_HEREDOC:
+            case REDIR_HEREDOC_LITERAL:
+            case REDIR_HERESTRING: {
+                size_t len = strlen(word);
+                int fd;
+                if (r.kind == REDIR_HERESTRING) {
+                    char* line = arena_alloc(&command_arena, len + 1);
+                    memcpy(line, word, len);
+                    line[len] = '\n';
+                    fd = body_fd(line, len + 1);
+                } else {
+                    fd = body_fd(word, len);
+                }
+                if (fd == -1) {
+                    status = -1;
+                } else {
+                    spawn_add_fd(actions, fd, r.fd);
+                }
+                break;
+            }
+        }
+        opened_remove(opened, &opened_count, r.fd);
+        opened[opened_count++] = r.fd;
+    }
+    arglist[kept] = NULL;
+    return status;
+}
@@ -0,0 +1,276 @@
+#include "shell.h"
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+
+// Process launch layer. Commands are started with posix_spawn, which glibc
+// implements with clone(CLONE_VM|CLONE_VFORK), so the cost of a launch does not
+// grow with the size of the shell's address space. The plain fork+execvp path
+// is kept as a fallback and can be selected with MYSHELL_SPAWN=fork.
+// Command names are resolved through the PATH cache in pathcache.c.
+
+int spawn_backend = SPAWN_POSIX;
+
+void spawn_init() {
+    char* backend = getenv("MYSHELL_SPAWN");
+    if (backend != NULL && strcmp(backend, "fork") == 0) {
+        spawn_backend = SPAWN_FORK;
+    }
+}
+
+void spawn_actions_init(spawn_actions* actions) {
+    actions->items = NULL;
+    actions->count = 0;
+    actions->capacity = 0;
+}
+
+// Drop every action, closing the descriptors the list owns
+void spawn_actions_reset(spawn_actions* actions) {
+    for (int i = 0; i < actions->count; i++) {
+        if (actions->items[i].owned) {
+            close(actions->items[i].src_fd);
+        }
+    }
+    actions->count = 0;
+}
+
+void spawn_actions_free(spawn_actions* actions) {
+    spawn_actions_reset(actions);
+    free(actions->items);
+    spawn_actions_init(actions);
+}
+
+static spawn_action* spawn_actions_push(spawn_actions* actions) {
+    if (actions->count == actions->capacity) {
+        int capacity = actions->capacity ? actions->capacity * 2 : 8;
+        spawn_action* items = realloc(actions->items, sizeof(spawn_action) * capacity);
+        if (items == NULL) {
+            return NULL;
+        }
+        actions->items = items;
+        actions->capacity = capacity;
+    }
+    spawn_action* action = &actions->items[actions->count++];
+    memset(action, 0, sizeof(*action));
+    return action;
+}
+
+int spawn_add_open(spawn_actions* actions, int fd, const char* path, int flags, mode_t mode) {
+    spawn_action* action = spawn_actions_push(actions);
+    if (action == NULL) return -1;
+    action->type = SPAWN_ACTION_OPEN;
+    action->fd = fd;
+    action->path = path;
+    action->flags = flags;
+    action->mode = mode;
+    return 0;
+}
+
+int spawn_add_dup2(spawn_actions* actions, int src_fd, int fd) {
+    spawn_action* action = spawn_actions_push(actions);
+    if (action == NULL) return -1;
+    action->type = SPAWN_ACTION_DUP2;
+    action->src_fd = src_fd;
+    action->fd = fd;
+    return 0;
+}
+
+// Like spawn_add_dup2, but src_fd belongs to the list from now on and is
+// closed when the list is reset or freed
+int spawn_add_fd(spawn_actions* actions, int src_fd, int fd) {
+    if (spawn_add_dup2(actions, src_fd, fd) == -1) {
+        close(src_fd);
+        return -1;
+    }
+    actions->items[actions->count - 1].owned = 1;
+    return 0;
+}
+
+int spawn_add_close(spawn_actions* actions, int fd) {
+    spawn_action* action = spawn_actions_push(actions);
+    if (action == NULL) return -1;
+    action->type = SPAWN_ACTION_CLOSE;
+    action->fd = fd;
+    return 0;
+}
+
+// Apply the actions to the current process. Used by the fork path and by
+// handle_redirection().
+int spawn_actions_apply(const spawn_actions* actions) {
+    for (int i = 0; i < actions->count; i++) {
+        const spawn_action* action = &actions->items[i];
+        switch (action->type) {
+            case SPAWN_ACTION_OPEN: {
+                int fd = open(action->path, action->flags, action->mode);
+                if (fd == -1) {
+                    perror(action->path);
+                    return -1;
+                }
+                if (fd != action->fd) {
+                    if (dup2(fd, action->fd) == -1) {
+                        perror("dup2 failed");
+                        close(fd);
+                        return -1;
+                    }
+                    close(fd);
+                }
+                break;
+            }
+            case SPAWN_ACTION_DUP2:
+                if (dup2(action->src_fd, action->fd) == -1) {
+                    perror("dup2 failed");
+                    return -1;
+                }
+                break;
+            case SPAWN_ACTION_CLOSE:
+                close(action->fd);
+                break;
+        }
+    }
+    return 0;
+}
+
+static pid_t spawn_fork(const char* path, char** argv, const spawn_actions* actions) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (placement_apply() == -1) {
+            _exit(1);
+        }
+        if (actions != NULL && spawn_actions_apply(actions) == -1) {
+            _exit(1);
+        }
+        if (path != NULL) {
+            execv(path, argv);
+        } else {
+            execvp(argv[0], argv);
+        }
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    if (pid < 0) {
+        perror("fork failed");
+    }
+    return pid;
+}
+
+// Returns 0 and sets *pid on success, or the posix_spawn error number.
+// A NULL path searches PATH with posix_spawnp.
+static int spawn_posix(pid_t* pid, const char* path, char** argv, const spawn_actions* actions) {
+    posix_spawn_file_actions_t file_actions;
+    posix_spawnattr_t attr;
+    sigset_t empty;
+
+    posix_spawn_file_actions_init(&file_actions);
+    for (int i = 0; actions != NULL && i < actions->count; i++) {
+        const spawn_action* action = &actions->items[i];
+        switch (action->type) {
+            case SPAWN_ACTION_OPEN:
+                posix_spawn_file_actions_addopen(&file_actions, action->fd, action->path,
+                                                 action->flags, action->mode);
+                break;
+            case SPAWN_ACTION_DUP2:
+                posix_spawn_file_actions_adddup2(&file_actions, action->src_fd, action->fd);
+                break;
+            case SPAWN_ACTION_CLOSE:
+                posix_spawn_file_actions_addclose(&file_actions, action->fd);
+                break;
+        }
+    }
+
+    // Children always start with an empty signal mask, whatever the shell blocks
+    posix_spawnattr_init(&attr);
+    sigemptyset(&empty);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    int err;
+    if (path != NULL) {
+        err = posix_spawn(pid, path, &file_actions, &attr, argv, environ);
+    } else {
+        err = posix_spawnp(pid, argv[0], &file_actions, &attr, argv, environ);
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&file_actions);
+    return err;
+}
+
+// posix_spawn does not say which step failed; blame a redirection target if
+// one cannot be opened, otherwise the command itself.
+static void spawn_report_error(char** argv, const spawn_actions* actions, int err) {
+    for (int i = 0; actions != NULL && i < actions->count; i++) {
+        const spawn_action* action = &actions->items[i];
+        if (action->type != SPAWN_ACTION_OPEN) continue;
+        int fd = open(action->path, action->flags & ~O_TRUNC, action->mode);
+        if (fd == -1) {
+            perror(action->path);
+            return;
+        }
+        close(fd);
+    }
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+}
+
+static pid_t spawn_command(char** argv, const spawn_actions* actions);
+
+// Start argv[0] with the given file actions applied. Returns the child pid,
+// or -1 if the command could not be started (the error is already reported).
+pid_t spawn_process(char** argv, const spawn_actions* actions) {
+    if (!trace_enabled) {
+        return spawn_command(argv, actions);
+    }
+    uint64_t start = trace_now();
+    pid_t pid = spawn_command(argv, actions);
+    trace_span("spawn", "spawn", start, argv[0]);
+    if (pid > 0) {
+        trace_child_start(pid, argv);
+    }
+    return pid;
+}
+
+static pid_t spawn_command(char** argv, const spawn_actions* actions) {
+    const char* path = NULL;
+    if (path_cache_enabled) {
+        path = path_lookup(argv[0]);
+        if (path == NULL) {
+            fprintf(stderr, "%s: command not found\n", argv[0]);
+            return -1;
+        }
+    }
+
+    // Placement has to happen in the child before exec
+    if (spawn_backend == SPAWN_FORK || placement_active()) {
+        return spawn_fork(path, argv, actions);
+    }
+
+    pid_t pid;
+    int err = spawn_posix(&pid, path, argv, actions);
+
+    // A cached binary that has gone away: forget it and search PATH again
+    if (err == ENOENT && path != NULL && path != argv[0] && access(path, X_OK) != 0) {
+        path_cache_invalidate(argv[0]);
+        path = path_lookup(argv[0]);
+        if (path == NULL) {
+            fprintf(stderr, "%s: command not found\n", argv[0]);
+            return -1;
+        }
+        err = spawn_posix(&pid, path, argv, actions);
+    }
+
+    if (err != 0) {
+        spawn_report_error(argv, actions, err);
+        return -1;
+    }
+    return pid;
+}
+
+// Convert a wait status into a shell exit status
+int wait_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 1;
+}
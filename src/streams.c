@@ -0,0 +1,221 @@
+#include "shell.h"
+#include <signal.h>
+
+// Stream builtins: commands such as cat and echo that the shell runs itself instead
+// of launching a binary, but that otherwise behave like external commands -
+// they take redirections, can be pipeline stages and can run in the
+// background.
+//
+// A stream builtin never touches the shell's own descriptors. Its stdin,
+// stdout and stderr are a small table (stdio_fds) built by applying a
+// command's spawn actions to it, so redirections cost one open() each and
+// nothing has to be restored afterwards. Redirections of descriptors above
+// 2 get slots of their own in the table, so 3>FILE 1>&3 reaches FILE and
+// not whatever the shell itself has open as 3.
+
+static const stream_builtin stream_builtins[] = {
+    {"cat", builtin_cat, ""},
+    {"tee", builtin_tee, "a"},
+    {"cp", builtin_cp, ""},
+    {"echo", builtin_echo, NULL},
+    {"printf", builtin_printf, NULL},
+    {"test", builtin_test, NULL},
+    {"[", builtin_test, NULL},
+    {"true", builtin_true, NULL},
+    {"false", builtin_false, NULL},
+    {":", builtin_true, NULL},
+};
+
+// Find the builtin for argv, or NULL. Commands given an option the builtin
+// does not implement are left to the external binary; builtins with NULL
+// options take any arguments.
+stream_builtin_fn stream_builtin_find(char** argv) {
+    if (argv[0] == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(stream_builtins) / sizeof(stream_builtins[0]); i++) {
+        const stream_builtin* b = &stream_builtins[i];
+        if (strcmp(argv[0], b->name) != 0) continue;
+        if (b->options == NULL) return b->fn;
+
+        for (int j = 1; argv[j] != NULL; j++) {
+            if (strcmp(argv[j], "--") == 0) break;
+            if (argv[j][0] != '-' || argv[j][1] == '\0') continue;
+            for (const char* c = argv[j] + 1; *c; c++) {
+                if (strchr(b->options, *c) == NULL) {
+                    return NULL;
+                }
+            }
+        }
+        return b->fn;
+    }
+    return NULL;
+}
+
+// Index of the extra slot for descriptor target, or -1
+static int stdio_extra(const stdio_fds* io, int target) {
+    for (int i = 0; i < io->extra_count; i++) {
+        if (io->extra_target[i] == target) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Build the descriptor table described by actions. Returns -1 (after
+// reporting the error) if a redirection target cannot be opened.
+int stdio_fds_open(stdio_fds* io, const spawn_actions* actions) {
+    for (int i = 0; i < 3; i++) {
+        io->fd[i] = i;
+        io->owned[i] = 0;
+    }
+    io->extra_count = 0;
+    io->extra_target = NULL;
+    io->extra_fd = NULL;
+    if (actions != NULL && actions->count > 0) {
+        io->extra_target = arena_alloc(&command_arena, sizeof(int) * actions->count);
+        io->extra_fd = arena_alloc(&command_arena, sizeof(int) * actions->count);
+    }
+
+    for (int i = 0; actions != NULL && i < actions->count; i++) {
+        const spawn_action* action = &actions->items[i];
+        if (action->fd < 0) {
+            continue;
+        }
+        int fd = -1;
+        int owned = 0;
+        switch (action->type) {
+            case SPAWN_ACTION_OPEN:
+                fd = open(action->path, action->flags | O_CLOEXEC, action->mode);
+                if (fd == -1) {
+                    perror(action->path);
+                    stdio_fds_close(io);
+                    return -1;
+                }
+                owned = 1;
+                break;
+            case SPAWN_ACTION_DUP2: {
+                // The source as this table has it so far
+                int src = action->src_fd;
+                int src_owned = 0;
+                int extra = src > STDERR_FILENO ? stdio_extra(io, src) : -1;
+                if (src <= STDERR_FILENO) {
+                    src = io->fd[action->src_fd];
+                    src_owned = io->owned[action->src_fd];
+                } else if (extra >= 0) {
+                    src = io->extra_fd[extra];
+                    src_owned = 1;
+                }
+                // A descriptor we opened ourselves, or one the action list
+                // owns (a here-document), is shared by duplicating it, so
+                // that each slot can be closed on its own
+                if (action->owned || (src_owned && src != -1)) {
+                    fd = fcntl(action->owned ? action->src_fd : src, F_DUPFD_CLOEXEC, 0);
+                    owned = 1;
+                } else {
+                    fd = src;
+                }
+                break;
+            }
+            case SPAWN_ACTION_CLOSE:
+                break;
+        }
+
+        if (action->fd > STDERR_FILENO) {
+            // Kept only to be duplicated later, so the table owns its copy
+            if (fd != -1 && !owned) {
+                fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            }
+            int extra = stdio_extra(io, action->fd);
+            if (extra < 0) {
+                extra = io->extra_count++;
+                io->extra_target[extra] = action->fd;
+            } else if (io->extra_fd[extra] != -1) {
+                close(io->extra_fd[extra]);
+            }
+            io->extra_fd[extra] = fd;
+            continue;
+        }
+        if (io->owned[action->fd]) {
+            close(io->fd[action->fd]);
+        }
+        io->fd[action->fd] = fd;
+        io->owned[action->fd] = owned;
+    }
+    return 0;
+}
+
+void stdio_fds_close(stdio_fds* io) {
+    for (int i = 0; i < 3; i++) {
+        if (io->owned[i]) {
+            close(io->fd[i]);
+            io->owned[i] = 0;
+        }
+    }
+    for (int i = 0; i < io->extra_count; i++) {
+        if (io->extra_fd[i] != -1) {
+            close(io->extra_fd[i]);
+        }
+    }
+    io->extra_count = 0;
+}
+
+// Call a builtin in the shell process on an already built descriptor table
+int stream_builtin_call(stream_builtin_fn fn, char** argv, stdio_fds* io) {
+    // Our own output must not overtake what is still buffered, and a
+    // reader going away must end the builtin rather than the shell
+    fflush(stdout);
+    struct sigaction ignore, saved;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &saved);
+
+    int status = fn(argv, io);
+
+    sigaction(SIGPIPE, &saved, NULL);
+    return status;
+}
+
+// Run a builtin in the shell process with the given redirections.
+// Returns its exit status.
+int run_stream_builtin(stream_builtin_fn fn, char** argv, const spawn_actions* actions) {
+    stdio_fds io;
+    if (stdio_fds_open(&io, actions) == -1) {
+        return 1;
+    }
+    uint64_t start = trace_enabled ? trace_now() : 0;
+    int status = stream_builtin_call(fn, argv, &io);
+    stdio_fds_close(&io);
+    if (trace_enabled) {
+        trace_span("builtin", argv[0], start, NULL);
+    }
+    return status;
+}
+
+// Run a builtin in a child process, for background jobs and for pipeline
+// stages that cannot run in the shell itself. Returns the pid or -1.
+pid_t spawn_stream_builtin(stream_builtin_fn fn, char** argv, const spawn_actions* actions) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (placement_apply() == -1) {
+            _exit(1);
+        }
+        if (actions != NULL && spawn_actions_apply(actions) == -1) {
+            _exit(1);
+        }
+        // Without an exec, O_CLOEXEC does not apply: drop the shell's other
+        // descriptors (pipe ends above all) so readers still see end of file
+        close_range(STDERR_FILENO + 1, ~0U, 0);
+        stdio_fds io = {{STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO}, {0, 0, 0}, 0, NULL, NULL};
+        _exit(fn(argv, &io));
+    }
+    if (pid < 0) {
+        perror("fork failed");
+    } else if (trace_enabled) {
+        trace_child_start(pid, argv);
+    }
+    return pid;
+}
@@ -0,0 +1,232 @@
+#include "shell.h"
+#include <errno.h>
+
+// test and [ as stream builtins.
+//
+// Expressions follow POSIX: with up to four arguments the meaning is fixed
+// by the argument count (so "test -n" and "test ! = x" do what sh does);
+// longer expressions are parsed with -o binding looser than -a, ! and
+// parentheses. Exit status is 0 for true, 1 for false and 2 for a usage
+// error.
+
+typedef struct {
+    char** argv;
+    int pos;
+    int count;
+    int error;
+    stdio_fds* io;
+} test_parser;
+
+static void test_error(test_parser* p, const char* message, const char* word) {
+    if (!p->error) {
+        dprintf(p->io->fd[STDERR_FILENO], "test: %s%s%s\n", word ? word : "", word ? ": " : "", message);
+    }
+    p->error = 1;
+}
+
+static int is_unary(const char* op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghLnprsStuwxz", op[1]) != NULL;
+}
+
+static int is_binary(const char* op) {
+    static const char* ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt",
+                                "-ge", "-nt", "-ot", "-ef", NULL};
+    for (int i = 0; ops[i] != NULL; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int test_integer(test_parser* p, const char* s, long long* value) {
+    char* end;
+    errno = 0;
+    while (*s == ' ' || *s == '\t') s++;
+    *value = strtoll(s, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (end == s || *end != '\0' || errno != 0) {
+        test_error(p, "integer expression expected", s);
+        return 0;
+    }
+    return 1;
+}
+
+static int test_unary(test_parser* p, char op, const char* arg) {
+    struct stat st;
+    switch (op) {
+        case 'n': return arg[0] != '\0';
+        case 'z': return arg[0] == '\0';
+        case 't': {
+            long long fd;
+            return test_integer(p, arg, &fd) && isatty((int)fd);
+        }
+        case 'L':
+        case 'h':
+            return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+    }
+    if (stat(arg, &st) != 0) {
+        return 0;
+    }
+    switch (op) {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+    }
+    return 0;
+}
+
+static int test_binary(test_parser* p, const char* left, const char* op, const char* right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(left, right) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(left, right) > 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f')) {
+        struct stat a, b;
+        int has_a = stat(left, &a) == 0;
+        int has_b = stat(right, &b) == 0;
+        if (strcmp(op, "-ef") == 0) {
+            return has_a && has_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        }
+        if (strcmp(op, "-nt") == 0) {
+            return has_a && (!has_b || a.st_mtim.tv_sec > b.st_mtim.tv_sec ||
+                             (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec > b.st_mtim.tv_nsec));
+        }
+        return has_b && (!has_a || a.st_mtim.tv_sec < b.st_mtim.tv_sec ||
+                         (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec < b.st_mtim.tv_nsec));
+    }
+
+    long long a, b;
+    if (!test_integer(p, left, &a) || !test_integer(p, right, &b)) {
+        return 0;
+    }
+    if (strcmp(op, "-eq") == 0) return a == b;
+    if (strcmp(op, "-ne") == 0) return a != b;
+    if (strcmp(op, "-lt") == 0) return a < b;
+    if (strcmp(op, "-le") == 0) return a <= b;
+    if (strcmp(op, "-gt") == 0) return a > b;
+    return a >= b;
+}
+
+// Recursive descent for expressions longer than four arguments
+
+static int test_or(test_parser* p);
+
+static char* test_next(test_parser* p) {
+    if (p->pos >= p->count) {
+        test_error(p, "argument expected", NULL);
+        return "";
+    }
+    return p->argv[p->pos++];
+}
+
+static int test_primary(test_parser* p) {
+    char* word = test_next(p);
+    if (strcmp(word, "!") == 0) {
+        return !test_primary(p);
+    }
+    if (strcmp(word, "(") == 0) {
+        int value = test_or(p);
+        if (p->pos >= p->count || strcmp(p->argv[p->pos], ")") != 0) {
+            test_error(p, "')' expected", NULL);
+            return 0;
+        }
+        p->pos++;
+        return value;
+    }
+    if (p->pos + 1 < p->count && is_binary(p->argv[p->pos])) {
+        char* op = p->argv[p->pos];
+        char* right = p->argv[p->pos + 1];
+        p->pos += 2;
+        return test_binary(p, word, op, right);
+    }
+    if (is_unary(word) && p->pos < p->count) {
+        return test_unary(p, word[1], test_next(p));
+    }
+    return word[0] != '\0';
+}
+
+static int test_and(test_parser* p) {
+    int value = test_primary(p);
+    while (p->pos < p->count && strcmp(p->argv[p->pos], "-a") == 0) {
+        p->pos++;
+        value = test_primary(p) && value;
+    }
+    return value;
+}
+
+static int test_or(test_parser* p) {
+    int value = test_and(p);
+    while (p->pos < p->count && strcmp(p->argv[p->pos], "-o") == 0) {
+        p->pos++;
+        value = test_and(p) || value;
+    }
+    return value;
+}
+
+// The POSIX rules for zero to four arguments
+static int test_eval(test_parser* p, char** argv, int count) {
+    switch (count) {
+        case 0:
+            return 0;
+        case 1:
+            return argv[0][0] != '\0';
+        case 2:
+            if (strcmp(argv[0], "!") == 0) return argv[1][0] == '\0';
+            if (is_unary(argv[0])) return test_unary(p, argv[0][1], argv[1]);
+            test_error(p, "unary operator expected", argv[0]);
+            return 0;
+        case 3:
+            if (is_binary(argv[1])) return test_binary(p, argv[0], argv[1], argv[2]);
+            if (strcmp(argv[1], "-a") == 0) return argv[0][0] != '\0' && argv[2][0] != '\0';
+            if (strcmp(argv[1], "-o") == 0) return argv[0][0] != '\0' || argv[2][0] != '\0';
+            if (strcmp(argv[0], "!") == 0) return !test_eval(p, argv + 1, 2);
+            if (strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0) return argv[1][0] != '\0';
+            test_error(p, "binary operator expected", argv[1]);
+            return 0;
+        case 4:
+            if (strcmp(argv[0], "!") == 0) return !test_eval(p, argv + 1, 3);
+            if (strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0) return test_eval(p, argv + 1, 2);
+            break;
+    }
+
+    p->argv = argv;
+    p->count = count;
+    p->pos = 0;
+    int value = test_or(p);
+    if (p->pos < p->count) {
+        test_error(p, "too many arguments", p->argv[p->pos]);
+    }
+    return value;
+}
+
+// test expr, or [ expr ]
+int builtin_test(char** argv, stdio_fds* io) {
+    int count = 0;
+    while (argv[count + 1] != NULL) count++;
+
+    if (strcmp(argv[0], "[") == 0) {
+        if (count == 0 || strcmp(argv[count], "]") != 0) {
+            dprintf(io->fd[STDERR_FILENO], "[: missing ']'\n");
+            return 2;
+        }
+        count--;
+    }
+
+    test_parser p = {0};
+    p.io = io;
+    int value = test_eval(&p, argv + 1, count);
+    if (p.error) {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+#include "shell.h"
+#include <errno.h>
+
+// Execution tracing in Chrome trace event format, for Perfetto or
+// chrome://tracing.
+//
+//     set -x FILE    start tracing into FILE (or MYSHELL_TRACE=FILE at startup)
+//     set +x         stop
+//
+// The shell records a complete ("X") event for each command line, parse
+// (tokenize), expansion, spawn, pipeline, in-shell builtin and wait. Every
+// child process gets a track of its own: it begins when the child is
+// spawned and ends when it is reaped, so the stages of a pipeline show up
+// side by side. Timestamps are CLOCK_MONOTONIC microseconds from the start
+// of the trace.
+//
+// Each event is a single O_APPEND write, so forked subshells can add their
+// own events to the same file. With tracing off, each traced site costs one
+// test of trace_enabled.
+
+#define TRACE_EVENT_SIZE 2048
+
+int trace_enabled = 0;
+
+static int trace_fd = -1;
+static pid_t trace_owner = 0;
+static uint64_t trace_origin = 0;
+
+uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Append s to buf as a JSON string body
+static int json_escape(char* buf, int size, const char* s) {
+    int len = 0;
+    for (; s != NULL && *s != '\0' && len < size - 7; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            buf[len++] = '\\';
+            buf[len++] = c;
+        } else if (c < 0x20) {
+            len += snprintf(buf + len, size - len, "\\u%04x", c);
+        } else {
+            buf[len++] = c;
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static void trace_write(const char* event, int len) {
+    if (len >= TRACE_EVENT_SIZE) {
+        return;
+    }
+    while (write(trace_fd, event, len) == -1 && errno == EINTR) {
+    }
+}
+
+// Write one event. pid is the track: the shell's own pid, or a child's.
+static void trace_emit(const char* phase, const char* cat, const char* name, uint64_t start, uint64_t end,
+                       pid_t pid, const char* detail) {
+    char event[TRACE_EVENT_SIZE];
+    char escaped_name[256];
+    char escaped_detail[1024];
+    json_escape(escaped_name, sizeof(escaped_name), name);
+    json_escape(escaped_detail, sizeof(escaped_detail), detail);
+
+    int len = snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f",
+                       escaped_name, cat, phase, (start - trace_origin) / 1e3);
+    if (phase[0] == 'X') {
+        len += snprintf(event + len, sizeof(event) - len, ",\"dur\":%.3f", (end - start) / 1e3);
+    }
+    len += snprintf(event + len, sizeof(event) - len, ",\"pid\":%d,\"tid\":%d", (int)pid, (int)pid);
+    if (detail != NULL) {
+        len += snprintf(event + len, sizeof(event) - len, ",\"args\":{\"detail\":\"%s\"}", escaped_detail);
+    }
+    len += snprintf(event + len, sizeof(event) - len, "}");
+    trace_write(event, len);
+}
+
+// A finished span of the shell (or subshell) itself, from start to now
+void trace_span(const char* cat, const char* name, uint64_t start, const char* detail) {
+    trace_emit("X", cat, name, start, trace_now(), getpid(), detail);
+}
+
+// Name a process track
+static void trace_name_track(pid_t pid, const char* name) {
+    char event[512];
+    char escaped[256];
+    json_escape(escaped, sizeof(escaped), name);
+    int len = snprintf(event, sizeof(event),
+                       ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+                       (int)pid, escaped);
+    trace_write(event, len);
+}
+
+// A child has been spawned: open its track
+void trace_child_start(pid_t pid, char** argv) {
+    char command[512];
+    int len = 0;
+    command[0] = '\0';
+    for (int i = 0; argv[i] != NULL && len < (int)sizeof(command) - 1; i++) {
+        len += snprintf(command + len, sizeof(command) - len, "%s%s", i ? " " : "", argv[i]);
+    }
+    trace_name_track(pid, argv[0]);
+    trace_emit("B", "process", argv[0], trace_now(), 0, pid, command);
+}
+
+// A child has been reaped: close its track
+void trace_child_end(pid_t pid, int status) {
+    char detail[32];
+    snprintf(detail, sizeof(detail), "status %d", wait_status(status));
+    trace_emit("E", "process", "", trace_now(), 0, pid, detail);
+}
+
+// set -x FILE
+int trace_start(const char* path) {
+    trace_stop();
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd == -1) {
+        fprintf(stderr, "set: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    static int registered = 0;
+    if (!registered) {
+        atexit(trace_stop);
+        registered = 1;
+    }
+    trace_owner = getpid();
+    trace_origin = trace_now();
+    trace_enabled = 1;
+
+    char event[256];
+    int len = snprintf(event, sizeof(event),
+                       "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"myshell\"}}",
+                       (int)trace_owner);
+    trace_write(event, len);
+    return 0;
+}
+
+// set +x, and at exit: close the JSON array. A forked copy of the shell
+// only stops writing.
+void trace_stop() {
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = 0;
+    if (getpid() == trace_owner) {
+        trace_write("\n]\n", 3);
+    }
+    close(trace_fd);
+    trace_fd = -1;
+}
@@ -0,0 +1,309 @@
+#include "shell.h"
+
+// Shell variable store: an open-addressing hash table with linear probing.
+// Names are interned - each distinct name is copied once into names_arena and
+// its slot keeps it for the life of the shell, so unset leaves the name behind
+// with a NULL value and a later assignment reuses the slot. The environment is
+// imported at startup, so lookups never need getenv().
+
+typedef struct {
+    const char* name;
+    unsigned int len;
+    unsigned int hash;
+    char* value;
+    int flags;
+} var_entry;
+
+static var_entry* var_table = NULL;
+static int var_table_size = 0;
+static int var_table_used = 0;   // slots holding a name, set or not
+static int var_count = 0;        // variables currently set
+static arena names_arena = {0};
+
+static var_entry* var_slot(const char* name, size_t len, unsigned int hash) {
+    unsigned int mask = var_table_size - 1;
+    unsigned int i = hash & mask;
+    while (var_table[i].name != NULL) {
+        var_entry* entry = &var_table[i];
+        if (entry->hash == hash && entry->len == len && memcmp(entry->name, name, len) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &var_table[i];
+}
+
+// Grow the table, dropping the names of unset variables on the way
+static void var_table_grow() {
+    var_entry* old = var_table;
+    int old_size = var_table_size;
+
+    var_table_size = old_size ? old_size * 2 : 64;
+    var_table = calloc(var_table_size, sizeof(var_entry));
+    if (var_table == NULL) {
+        perror("calloc failed");
+        exit(1);
+    }
+    var_table_used = 0;
+    for (int i = 0; i < old_size; i++) {
+        if (old[i].value != NULL) {
+            *var_slot(old[i].name, old[i].len, old[i].hash) = old[i];
+            var_table_used++;
+        }
+    }
+    free(old);
+}
+
+// Look up a variable by a name that need not be NUL-terminated
+const char* var_lookup(const char* name, size_t len) {
+    if (var_table_size == 0) {
+        return NULL;
+    }
+    return var_slot(name, len, hash_bytes(name, len))->value;
+}
+
+const char* var_get(const char* name) {
+    return var_lookup(name, strlen(name));
+}
+
+void var_set(const char* name, size_t len, const char* value, int flags) {
+    if ((var_table_used + 1) * 10 > var_table_size * 7) {
+        var_table_grow();
+    }
+
+    unsigned int hash = hash_bytes(name, len);
+    var_entry* entry = var_slot(name, len, hash);
+    if (entry->name == NULL) {
+        entry->name = arena_strndup(&names_arena, name, len);
+        entry->len = len;
+        entry->hash = hash;
+        entry->flags = 0;
+        var_table_used++;
+    }
+    if (entry->value == NULL) {
+        var_count++;
+    } else {
+        free(entry->value);
+    }
+    entry->value = strdup(value);
+    entry->flags |= flags;
+
+    if (entry->flags & VAR_EXPORTED) {
+        setenv(entry->name, entry->value, 1);
+    }
+}
+
+void var_export(const char* name) {
+    if (var_table_size == 0) {
+        return;
+    }
+    var_entry* entry = var_slot(name, strlen(name), hash_string(name));
+    if (entry->value != NULL) {
+        entry->flags |= VAR_EXPORTED;
+        setenv(entry->name, entry->value, 1);
+    }
+}
+
+int var_unset(const char* name) {
+    if (var_table_size == 0) {
+        return 0;
+    }
+    var_entry* entry = var_slot(name, strlen(name), hash_string(name));
+    if (entry->value == NULL) {
+        return 0;
+    }
+    if (entry->flags & VAR_EXPORTED) {
+        unsetenv(entry->name);
+    }
+    free(entry->value);
+    entry->value = NULL;
+    entry->flags = 0;
+    var_count--;
+    return 1;
+}
+
+// Import the environment as exported variables. The values are already in
+// environ, so this skips var_set()'s setenv() - which would copy the whole
+// environment once per variable - and sizes the table up front.
+void variables_init() {
+    shell_pid = getpid();
+
+    int count = 0;
+    while (environ[count] != NULL) count++;
+    while (var_table_size * 7 < (count + 1) * 10) {
+        var_table_grow();
+    }
+
+    for (char** env = environ; *env != NULL; env++) {
+        char* equal_sign = strchr(*env, '=');
+        if (equal_sign == NULL || equal_sign == *env) {
+            continue;
+        }
+        size_t len = equal_sign - *env;
+        unsigned int hash = hash_bytes(*env, len);
+        var_entry* entry = var_slot(*env, len, hash);
+        if (entry->name == NULL) {
+            entry->name = arena_strndup(&names_arena, *env, len);
+            entry->len = len;
+            entry->hash = hash;
+            var_table_used++;
+        }
+        if (entry->value == NULL) {
+            var_count++;
+        } else {
+            free(entry->value);
+        }
+        entry->value = strdup(equal_sign + 1);
+        entry->flags = VAR_EXPORTED;
+    }
+}
+
+void variables_clear() {
+    for (int i = 0; i < var_table_size; i++) {
+        free(var_table[i].value);
+    }
+    free(var_table);
+    var_table = NULL;
+    var_table_size = 0;
+    var_table_used = 0;
+    var_count = 0;
+    arena_destroy(&names_arena);
+}
+
+// Check if command is a variable assignment
+int is_variable_assignment(char** arglist) {
+    if (arglist[0] == NULL) {
+        return 0;
+    }
+
+    char* cmd = arglist[0];
+    char* equal_sign = strchr(cmd, '=');
+
+    // Must have = sign and it shouldn't be the first character
+    if (equal_sign == NULL || equal_sign == cmd) {
+        return 0;
+    }
+
+    // Check that the part before = is a valid variable name
+    char* var_name = cmd;
+    int name_len = equal_sign - cmd;
+
+    for (int i = 0; i < name_len; i++) {
+        if (!isalnum(var_name[i]) && var_name[i] != '_') {
+            return 0; // Invalid character in variable name
+        }
+    }
+
+    // Variable name cannot start with a number
+    if (isdigit(var_name[0])) {
+        return 0;
+    }
+
+    return 1; // Valid variable assignment
+}
+
+// Handle variable assignment. Quotes were already removed by tokenize();
+// the value is expanded.
+void handle_variables(char** arglist) {
+    if (arglist[0] == NULL) return;
+
+    char* assignment = arglist[0];
+    char* equal_sign = strchr(assignment, '=');
+    if (equal_sign == NULL) return;
+
+    var_set(assignment, equal_sign - assignment, expand_word(equal_sign + 1), 0);
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const var_entry* x = *(const var_entry* const*)a;
+    const var_entry* y = *(const var_entry* const*)b;
+    return strcmp(x->name, y->name);
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Collect the set variables whose exported flag matches, sorted by name
+static var_entry** sorted_variables(int exported, int* count) {
+    var_entry** entries = malloc(sizeof(var_entry*) * (var_count + 1));
+    int n = 0;
+    for (int i = 0; i < var_table_size; i++) {
+        var_entry* entry = &var_table[i];
+        if (entry->value != NULL && !!(entry->flags & VAR_EXPORTED) == exported) {
+            entries[n++] = entry;
+        }
+    }
+    qsort(entries, n, sizeof(var_entry*), compare_entries);
+    *count = n;
+    return entries;
+}
+
+// Names of the set variables starting with prefix, sorted, for completion.
+// The array and the names are malloc'd; the array ends with NULL.
+char** var_names_with_prefix(const char* prefix, size_t len) {
+    char** names = malloc(sizeof(char*) * (var_count + 1));
+    int n = 0;
+    for (int i = 0; i < var_table_size; i++) {
+        var_entry* entry = &var_table[i];
+        if (entry->value != NULL && entry->len >= len && memcmp(entry->name, prefix, len) == 0) {
+            names[n++] = strdup(entry->name);
+        }
+    }
+    names[n] = NULL;
+    qsort(names, n, sizeof(char*), compare_names);
+    return names;
+}
+
+// Print variables
+void print_variables() {
+    int count;
+    var_entry** entries = sorted_variables(0, &count);
+    if (count == 0) {
+        printf("No shell variables defined\n");
+    } else {
+        printf("Shell variables:\n");
+        for (int i = 0; i < count; i++) {
+            printf("  %s=%s\n", entries[i]->name, entries[i]->value);
+        }
+    }
+    free(entries);
+
+    entries = sorted_variables(1, &count);
+    printf("\nEnvironment variables:\n");
+    for (int i = 0; i < count; i++) {
+        printf("  %s=%s\n", entries[i]->name, entries[i]->value);
+    }
+    free(entries);
+}
+
+// export [NAME[=value]...]
+int handle_export(char** arglist) {
+    if (arglist[1] == NULL) {
+        int count;
+        var_entry** entries = sorted_variables(1, &count);
+        for (int i = 0; i < count; i++) {
+            printf("export %s=%s\n", entries[i]->name, entries[i]->value);
+        }
+        free(entries);
+        return 0;
+    }
+
+    for (int i = 1; arglist[i] != NULL; i++) {
+        char* equal_sign = strchr(arglist[i], '=');
+        if (equal_sign != NULL) {
+            var_set(arglist[i], equal_sign - arglist[i], equal_sign + 1, VAR_EXPORTED);
+        } else {
+            var_export(arglist[i]);
+        }
+    }
+    return 0;
+}
+
+// unset NAME...
+int handle_unset(char** arglist) {
+    for (int i = 1; arglist[i] != NULL; i++) {
+        var_unset(arglist[i]);
+    }
+    return 0;
+}
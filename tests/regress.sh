@@ -0,0 +1,102 @@
+#!/bin/sh
+# Regression checks: each case runs a command line with -c, or types lines
+# at a terminal, and compares the shell's output with the expected output.
+#
+# usage: tests/regress.sh path/to/myshell
+
+SHELL_BIN=${1:-bin/myshell}
+TMP=$(mktemp -d /tmp/myshell-regress-XXXXXX)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+case $SHELL_BIN in
+    /*) ;;
+    *) SHELL_BIN=$OLDPWD/$SHELL_BIN ;;
+esac
+
+failed=0
+total=0
+
+# check NAME EXPECTED LINE
+check() {
+    total=$((total + 1))
+    actual=$("$SHELL_BIN" -c "$3" 2>/dev/null)
+    if [ "$actual" != "$2" ]; then
+        failed=$((failed + 1))
+        printf 'FAIL %s\n  line:     %s\n  expected: %s\n  actual:   %s\n' "$1" "$3" "$2" "$actual"
+    fi
+}
+
+# check_interactive NAME EXPECTED LINES: LINES are typed at a terminal and
+# the job notices and listings in the output compared.
+# Skipped without script(1).
+check_interactive() {
+    command -v script >/dev/null || return 0
+    total=$((total + 1))
+    actual=$(printf '%s\nexit\n' "$3" | script -qec "$SHELL_BIN" /dev/null 2>/dev/null |
+        grep -oE '\[[0-9]+\] Done|No background')
+    if [ "$actual" != "$2" ]; then
+        failed=$((failed + 1))
+        printf 'FAIL %s\n  lines:    %s\n  expected: %s\n  actual:   %s\n' "$1" "$3" "$2" "$actual"
+    fi
+}
+
+# Prefixed lines in a loop body must not free the loop's parse tree
+WORDS=$(seq 1 2000 | tr '\n' ' ')
+check "time in a for body" "2000" "for i in $WORDS; do time true; X=\$i; done; echo \$X"
+check "pipesize in a for body" "1
+2
+3" "for i in 1 2 3; do pipesize 1M echo \$i; done"
+
+# Builtins see descriptors above 2 that their own redirections opened
+check "builtin 3>file 1>&3" "hi" "echo hi 3>f3 1>&3; cat f3"
+check "builtin 3>file 4>&3 1>&4" "hi" "echo hi 3>f3 4>&3 1>&4; cat f3"
+
+# A script's finished background jobs free their slots without anyone
+# running jobs
+JOBS=$(for i in $(seq 1 50); do echo "true &"; done)
+check "finished jobs are freed" "No background jobs" "$JOBS
+sleep 1
+jobs"
+
+# At a terminal a reported job is listed once by jobs, or dropped after the
+# next command line
+check_interactive "jobs lists a done job once" "[1] Done
+[1] Done
+No background" "sleep 0.2 &
+sleep 1
+jobs
+jobs"
+check_interactive "done job dropped two prompts on" "[1] Done
+No background" "sleep 0.2 &
+sleep 1
+true
+jobs"
+
+# Here-document bodies expand unless the delimiter is quoted
+check "unquoted here-document expands" "v sub" "X=v
+cat <<EOF
+\$X \$(echo sub)
+EOF"
+check "quoted here-document is literal" "\$X" "X=v
+cat <<'EOF'
+\$X
+EOF"
+
+# N>&M refuses descriptors the user did not open
+check "dup of an unopened descriptor" "2" "echo hi 1>&9; echo \$?"
+
+# cat refuses to append a file to itself
+check "cat input file is output file" "1
+1" "echo hi > f; cat f >> f; echo \$?; wc -l < f"
+
+# A substitution nested in an external command runs once
+check "nested substitution runs once" "1" "echo \$(wc -c \$(echo run >> cnt; echo cnt)) > /dev/null; wc -l < cnt"
+
+# A control structure may follow other commands in a ';' chain
+check "while after a chain segment" "0" "X=3; while test \$X -gt 0; do X=\$(expr \$X - 1); done; echo \$X"
+check "for after a chain segment" "ab
+c
+after" "X=ab; for w in \$X c; do echo \$w; done; echo after"
+
+echo "$((total - failed))/$total passed"
+[ "$failed" -eq 0 ]